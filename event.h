@@ -0,0 +1,36 @@
+#ifndef _EVENT_H_
+#define _EVENT_H_
+
+/**
+ * Scheduler events, in the order they can be reported.
+ * Every event names a process and carries one argument whose meaning depends on the type.
+ */
+typedef enum EVENT_TYPE {
+	EVENT_CREATE,		// arg: priority of the new process
+	EVENT_FORK,			// arg: PID of the forked parent
+	EVENT_KILL,			// arg: priority of the killed process
+	EVENT_QUANTUM,		// arg: priority of the pre-empted process
+	EVENT_READY,		// arg: priority (ready queue) the process joined
+	EVENT_RUN,			// arg: priority (ready queue) the process was selected from
+	EVENT_BLOCK_SEM,	// arg: semaphore ID
+	EVENT_BLOCK_SEND,	// arg: PID the message was sent to
+	EVENT_BLOCK_RCV,	// arg: unused (-1)
+	EVENT_WAKE,			// arg: PID of the process that woke it
+	EVENT_MSG_ENQUEUE,	// pid: receiver, arg: sender
+	EVENT_MSG_DEQUEUE,	// pid: receiver, arg: sender
+	EVENT_MSG_REJECT,	// pid: receiver whose message queue was full, arg: sender
+	EVENT_STEAL,		// arg: CPU the process was taken from
+	EVENT_SLEEP,		// arg: ticks the process sleeps for
+	EVENT_TIMEOUT,		// arg: semaphore ID the process gave up waiting on
+	EVENT_RELEASE,		// arg: number of the real-time job released, from 1
+	EVENT_DEADLINE_MISS,	// arg: ticks the real-time job finished after its deadline
+	NUM_EVENT_TYPES
+} EVENT_TYPE;
+
+static const char * const EVENT_NAMES[NUM_EVENT_TYPES] = {
+	"CREATE", "FORK", "KILL", "QUANTUM", "READY", "RUN",
+	"BLOCK_SEM", "BLOCK_SEND", "BLOCK_RCV", "WAKE", "MSG_ENQUEUE", "MSG_DEQUEUE",
+	"MSG_REJECT", "STEAL", "SLEEP", "TIMEOUT", "RELEASE", "DEADLINE_MISS"
+};
+
+#endif /* _EVENT_H_ */
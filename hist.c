@@ -0,0 +1,99 @@
+/***************************************************************
+ * Log-bucketed latency histograms                             *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "hist.h"
+
+/***************************************************************
+ * Statics                                                     *
+ ***************************************************************/
+static int bucketIndex(uint64_t value);
+static uint64_t bucketHighest(int index);
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/* Counts one value. Costs a bit scan and an increment. */
+void HistRecord(HISTOGRAM *hist, uint64_t value) {
+	hist->counts[bucketIndex(value)]++;
+	hist->total++;
+	hist->sum += value;
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+/* Adds every value recorded in from to into */
+void HistMerge(HISTOGRAM *into, const HISTOGRAM *from) {
+	if (from->total == 0) {
+		return;
+	}
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		into->counts[i] += from->counts[i];
+	}
+	into->total += from->total;
+	into->sum += from->sum;
+	if (from->max > into->max) {
+		into->max = from->max;
+	}
+}
+
+/**
+ * Returns the value at or below which the given percent of values fall, rounded up to the
+ * highest value of its bucket but never past the largest value recorded. 0 if nothing was recorded.
+ */
+uint64_t HistPercentile(const HISTOGRAM *hist, double percentile) {
+	if (hist->total == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t)(percentile / 100.0 * (double)hist->total + 0.5);
+	rank = rank < 1 ? 1 : rank;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->counts[i];
+		if (seen >= rank) {
+			uint64_t highest = bucketHighest(i);
+			return highest < hist->max ? highest : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+double HistMean(const HISTOGRAM *hist) {
+	return hist->total ? (double)hist->sum / (double)hist->total : 0.0;
+}
+
+/***************************************************************
+ * Static Functions                                            *
+ ***************************************************************/
+
+/**
+ * Values with their top bit at position top >= HIST_SUB_BITS are shifted down to keep
+ * HIST_SUB_BITS significant bits, the top one always set, which picks one of the
+ * HIST_SUB_BUCKETS / 2 buckets for that power of two.
+ */
+static int bucketIndex(uint64_t value) {
+	if (value < HIST_SUB_BUCKETS) {
+		return (int)value;
+	}
+	int top = 63 - __builtin_clzll(value);
+	int shift = top - HIST_SUB_BITS + 1;
+	return HIST_SUB_BUCKETS + (top - HIST_SUB_BITS) * (HIST_SUB_BUCKETS / 2) +
+		(int)((value >> shift) - HIST_SUB_BUCKETS / 2);
+}
+
+/* Returns the largest value that falls in the bucket */
+static uint64_t bucketHighest(int index) {
+	if (index < HIST_SUB_BUCKETS) {
+		return (uint64_t)index;
+	}
+	int top = (index - HIST_SUB_BUCKETS) / (HIST_SUB_BUCKETS / 2) + HIST_SUB_BITS;
+	uint64_t significant = (uint64_t)((index - HIST_SUB_BUCKETS) % (HIST_SUB_BUCKETS / 2) + HIST_SUB_BUCKETS / 2);
+	int shift = top - HIST_SUB_BITS + 1;
+	return ((significant + 1) << shift) - 1;
+}
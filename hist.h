@@ -0,0 +1,40 @@
+#ifndef _HIST_H_
+#define _HIST_H_
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include <stdint.h>
+
+/***************************************************************
+ * Defines                                                     *
+ ***************************************************************/
+#define HIST_SUB_BITS		5	// Values are kept to within 1 part in 2^(HIST_SUB_BITS - 1)
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		(HIST_SUB_BUCKETS + (64 - HIST_SUB_BITS) * (HIST_SUB_BUCKETS / 2))
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/**
+ * Log-bucketed histogram in the style of HdrHistogram. Values below HIST_SUB_BUCKETS each have
+ * a bucket of their own. Above that, every power of two is split into HIST_SUB_BUCKETS / 2
+ * equal buckets, so any 64-bit value is recorded with a relative error under 1/16 in fixed space.
+ */
+typedef struct HISTOGRAM {
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t total;		// Values recorded
+	uint64_t sum;
+	uint64_t max;
+} HISTOGRAM;
+
+/***************************************************************
+ * Function prototypes                                         *
+ ***************************************************************/
+void HistRecord(HISTOGRAM *hist, uint64_t value);
+void HistMerge(HISTOGRAM *into, const HISTOGRAM *from);
+uint64_t HistPercentile(const HISTOGRAM *hist, double percentile);
+double HistMean(const HISTOGRAM *hist);
+
+#endif /* _HIST_H_ */
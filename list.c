@@ -11,15 +11,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <pthread.h>
 
 /***************************************************************
  * Defines                                                     *
  ***************************************************************/
-#define NODE_POOL_SIZE 100
-#define LIST_POOL_SIZE 10
+#define CACHE_LINE_SIZE 64
+#define NODE_CHUNK_SIZE 1024
+#define LIST_CHUNK_SIZE 64
+#define NODE_CACHE_SIZE 256	// Nodes each thread can hold in concurrent mode
+#define NODE_BATCH_SIZE 128	// Nodes moved between a thread's cache and the shared pool at a time
+#define LIST_CACHE_SIZE 32
+#define LIST_BATCH_SIZE 16
 
-#define NODE_POOL_FULL				(numNodesAvailable <= 0)
-#define LIST_POOL_FULL				(numListsAvailable <= 0)
+/**
+ * The pools grow by one chunk when they run dry, so they are only "full" if that fails.
+ * In concurrent mode each thread takes from its own cache, refilled from the shared pool.
+ */
+#define NODE_POOL_FULL				(concurrentPools ? (numNodesCached <= 0 && refillNodeCache() < 0) \
+										: (numNodesAvailable <= 0 && growNodePool() < 0))
+#define LIST_POOL_FULL				(concurrentPools ? (numListsCached <= 0 && refillListCache() < 0) \
+										: (numListsAvailable <= 0 && growListPool() < 0))
 #define LIST_IS_EMPTY				(list->size == 0)
 #define CURRENT_NODE_BEYOND_START	(list->currentIsBeyond == -1)
 #define CURRENT_NODE_BEYOND_END		(list->currentIsBeyond == 1)
@@ -29,14 +42,43 @@
 /***************************************************************
  * Statics                                                     *
  ***************************************************************/
-static NODE nodePool[NODE_POOL_SIZE];
-static LIST listPool[LIST_POOL_SIZE];
-static int availableNodeArr[NODE_POOL_SIZE];
-static int availableListArr[LIST_POOL_SIZE];
-static int numNodesAvailable = NODE_POOL_SIZE;
-static int numListsAvailable = LIST_POOL_SIZE;
-static int initialisationFlag = 0;
+/**
+ * Nodes and lists are carved out of cache-line-aligned chunks that are never moved or freed,
+ * so pointers handed out stay valid. The available arrays are stacks of free slots.
+ */
+static NODE **availableNodeArr = NULL;
+static LIST **availableListArr = NULL;
+static int numNodesAvailable = 0;
+static int numListsAvailable = 0;
+static int numNodeChunks = 0;
+static int numListChunks = 0;
 
+/**
+ * Concurrent mode. The shared pool above is only touched with poolLock held, and only to move
+ * a batch in or out of a thread's cache, so threads rarely contend on it.
+ */
+static int concurrentPools = 0;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cacheKey;	// Only used to return a thread's cache to the pool when it exits
+static __thread NODE *nodeCache[NODE_CACHE_SIZE];
+static __thread LIST *listCache[LIST_CACHE_SIZE];
+static __thread int numNodesCached = 0;
+static __thread int numListsCached = 0;
+static __thread int cacheRegistered = 0;	// Set once the thread's cache is due back to the pool at exit
+
+static void *allocChunk(size_t size);
+static int growNodePool(void);
+static int growListPool(void);
+static int refillNodeCache(void);
+static int refillListCache(void);
+static void spillNodeCache(int count);
+static void spillListCache(int count);
+static void registerThreadCache(void);
+static void releaseThreadCache(void *unused);
+static NODE *allocNode(void);
+static void freeNode(NODE *node);
+static LIST *allocList(void);
+static void freeList(LIST *list);
 static void addItemToEmptyList(LIST *list, void *item);
 static void addItemToListSizeOne(LIST *list, void *item, int afterHead);
 static void addItemBetweenTwoOthers(LIST *list, void *item, NODE *pre, NODE *post);
@@ -51,17 +93,6 @@ static void addItemBetweenTwoOthers(LIST *list, void *item, NODE *pre, NODE *pos
 LIST *ListCreate(void) {
 	LIST list;
 
-	/* Set all of the indices of the available nodes when the first list is created */
-	if (!initialisationFlag) {
-		for (int i = 0; i < NODE_POOL_SIZE; i++) {
-			availableNodeArr[i] = i;
-		}
-		for (int i = 0; i < LIST_POOL_SIZE; i++) {
-			availableListArr[i] = i;
-		}
-		initialisationFlag = 1;
-	}
-
 	/* Ensure there is space in the list pool */
 	if (LIST_POOL_FULL) {
 		return NULL;
@@ -75,10 +106,9 @@ LIST *ListCreate(void) {
 	list.currentIsBeyond = 0;
 
 	/* Add local new list to the list pool and return it */
-	int listIndex = availableListArr[numListsAvailable - 1];
-	listPool[listIndex] = list;
-	numListsAvailable--;
-	return &listPool[listIndex];
+	LIST *newList = allocList();
+	*newList = list;
+	return newList;
 }
 
 /** 
@@ -250,14 +280,13 @@ int ListAppend(LIST *list, void *item) {
 	node.previous = list->tail;
 	node.next = NULL;
 	
-	int nodeIndex = availableNodeArr[numNodesAvailable - 1];
-	nodePool[nodeIndex] = node;
-	numNodesAvailable--;
+	NODE *newNode = allocNode();
+	*newNode = node;
 
 	if (list->size == 1) {
-		list->head->next = &nodePool[nodeIndex];
+		list->head->next = newNode;
 	}
-	list->tail->next = &nodePool[nodeIndex];
+	list->tail->next = newNode;
 	list->tail->next->previous = list->tail;
 	list->tail = list->tail->next;
 	list->current = list->tail;
@@ -287,12 +316,11 @@ int ListPrepend(LIST *list, void *item) {
 	node.previous = NULL;
 	node.next = list->head;
 
-	int nodeIndex = availableNodeArr[numNodesAvailable - 1];
-	nodePool[nodeIndex] = node;
-	numNodesAvailable--;
+	NODE *newNode = allocNode();
+	*newNode = node;
 
-	list->head->previous = &nodePool[nodeIndex];
-	list->head = &nodePool[nodeIndex];
+	list->head->previous = newNode;
+	list->head = newNode;
 	list->size++;
 	list->current = list->head;
 	list->currentIsBeyond = 0;
@@ -310,7 +338,7 @@ void *ListRemove(LIST *list) {
 	}
 
 	void *item = list->current->item;
-	ptrdiff_t nodeIndex = list->current - nodePool;
+	NODE *removedNode = list->current;
 
 	if (list->size == 1) {
 		list->head = NULL;
@@ -333,8 +361,7 @@ void *ListRemove(LIST *list) {
 	list->currentIsBeyond = 0;
 	list->size--;
 
-	availableNodeArr[numNodesAvailable] = nodeIndex;
-	numNodesAvailable++;
+	freeNode(removedNode);
 	return item;
 }
 
@@ -368,9 +395,7 @@ void ListConcat(LIST *list1, LIST *list2) {
 	}
 	list1->size += list2->size;
 
-	ptrdiff_t listIndex2 = list2 - listPool;
-	availableListArr[numListsAvailable] = listIndex2;
-	numListsAvailable++;
+	freeList(list2);
 	list2 = NULL;
 }
 
@@ -390,15 +415,12 @@ void ListFree(LIST *list, void (*itemFree)(void *)) {
 			(* itemFree)(nodeToDelete->item);
 		}
 
-		ptrdiff_t nodeIndex = nodeToDelete - nodePool;
-		availableNodeArr[numNodesAvailable] = nodeIndex;
-		numNodesAvailable++;
-
 		NODE *oldNode = nodeToDelete;
 		nodeToDelete = nodeToDelete->next;
 		oldNode->item = NULL;
 		oldNode->previous = NULL;
 		oldNode->next = NULL;
+		freeNode(oldNode);
 	}
 
 	list->current = NULL;
@@ -407,9 +429,7 @@ void ListFree(LIST *list, void (*itemFree)(void *)) {
 	list->size = 0;
 	list->currentIsBeyond = 0;
 
-	ptrdiff_t listIndex = list - listPool;
-	availableListArr[numListsAvailable] = listIndex;
-	numListsAvailable++;
+	freeList(list);
 }
 
 /**
@@ -422,9 +442,7 @@ void *ListTrim(LIST *list) {
 	}
 
 	void *item = list->tail->item;
-	ptrdiff_t nodeIndex = list->tail - nodePool;
-	availableNodeArr[numNodesAvailable] = nodeIndex;
-	numNodesAvailable++;
+	NODE *removedNode = list->tail;
 
 	if (list->size > 1) {
 		list->tail = list->tail->previous;
@@ -438,6 +456,7 @@ void *ListTrim(LIST *list) {
 	list->size--;
 	list->currentIsBeyond = 0;
 
+	freeNode(removedNode);
 	return item;
 }
 
@@ -471,11 +490,354 @@ void *ListSearch(LIST *list, int (*comparator)(void *, void *), void *comparison
 	return NULL;
 }
 
+/**
+ * Fills in the current size of the node and list pools.
+ * Chunk counts only grow, so the difference between two calls counts the allocations made.
+ * In concurrent mode the available counts include the calling thread's cache, but not other threads'.
+ */
+void ListPoolStats(LIST_POOL_STATS *stats) {
+	if (concurrentPools) {
+		pthread_mutex_lock(&poolLock);
+	}
+	stats->nodeChunks = numNodeChunks;
+	stats->listChunks = numListChunks;
+	stats->nodesAvailable = numNodesAvailable + numNodesCached;
+	stats->listsAvailable = numListsAvailable + numListsCached;
+	if (concurrentPools) {
+		pthread_mutex_unlock(&poolLock);
+	}
+}
+
+/**
+ * Lets more than one thread use the list module at once, each on lists of its own.
+ * Every thread then allocates from a cache of its own, which it refills from and spills back to
+ * the shared pool in batches. A thread's cache goes back to the pool when the thread exits.
+ * Must be called before a second thread starts using lists. It can't be turned off again.
+ * Returns 0 on success, -1 on failure.
+ */
+int ListPoolEnableConcurrency(void) {
+	if (concurrentPools) {
+		return 0;
+	}
+	if (pthread_key_create(&cacheKey, releaseThreadCache) != 0) {
+		return -1;
+	}
+	concurrentPools = 1;
+	return 0;
+}
+
+/**
+ * Initialises an empty intrusive list.
+ */
+void IListInit(ILIST *list) {
+	list->head = NULL;
+	list->tail = NULL;
+	list->size = 0;
+}
+
+/**
+ * Returns the number of links in the intrusive list.
+ */
+int IListCount(ILIST *list) {
+	return list->size;
+}
+
+/**
+ * Returns the first link in the intrusive list, or NULL if it is empty.
+ */
+LINK *IListFirst(ILIST *list) {
+	return list->head;
+}
+
+/**
+ * Adds a link to the end of the intrusive list. The link must not be on any list.
+ */
+void IListAppend(ILIST *list, LINK *link) {
+	link->previous = list->tail;
+	link->next = NULL;
+	if (list->tail != NULL) {
+		list->tail->next = link;
+	} else {
+		list->head = link;
+	}
+	list->tail = link;
+	list->size++;
+}
+
+/**
+ * Adds a link to the front of the intrusive list. The link must not be on any list.
+ */
+void IListPrepend(ILIST *list, LINK *link) {
+	link->previous = NULL;
+	link->next = list->head;
+	if (list->head != NULL) {
+		list->head->previous = link;
+	} else {
+		list->tail = link;
+	}
+	list->head = link;
+	list->size++;
+}
+
+/**
+ * Adds a link to the intrusive list right after another link on it, or at the front if after
+ * is NULL. The link must not be on any list.
+ */
+void IListInsertAfter(ILIST *list, LINK *after, LINK *link) {
+	if (after == NULL) {
+		IListPrepend(list, link);
+		return;
+	}
+	link->previous = after;
+	link->next = after->next;
+	if (after->next != NULL) {
+		after->next->previous = link;
+	} else {
+		list->tail = link;
+	}
+	after->next = link;
+	list->size++;
+}
+
+/**
+ * Unlinks a link from the intrusive list it belongs to.
+ */
+void IListRemove(ILIST *list, LINK *link) {
+	if (link->previous != NULL) {
+		link->previous->next = link->next;
+	} else {
+		list->head = link->next;
+	}
+	if (link->next != NULL) {
+		link->next->previous = link->previous;
+	} else {
+		list->tail = link->previous;
+	}
+	link->previous = NULL;
+	link->next = NULL;
+	list->size--;
+}
+
+/**
+ * Removes and returns the first link in the intrusive list, or NULL if it is empty.
+ */
+LINK *IListPop(ILIST *list) {
+	LINK *link = list->head;
+	if (link != NULL) {
+		IListRemove(list, link);
+	}
+	return link;
+}
+
 
 /***************************************************************
  * Static Functions                                            *
  ***************************************************************/
 
+/**
+ * Allocate a chunk aligned to a cache line, rounding the size up to a whole number of lines
+ */
+static void *allocChunk(size_t size) {
+	size_t alignedSize = (size + CACHE_LINE_SIZE - 1) & ~((size_t)CACHE_LINE_SIZE - 1);
+	return aligned_alloc(CACHE_LINE_SIZE, alignedSize);
+}
+
+/**
+ * Add another chunk of nodes to the node pool.
+ * Returns 0 on success, -1 if memory could not be allocated.
+ */
+static int growNodePool(void) {
+	size_t newTotal = (size_t)(numNodeChunks + 1) * NODE_CHUNK_SIZE;
+	NODE **newAvailableArr = (NODE **)realloc(availableNodeArr, newTotal * sizeof(NODE *));
+	if (newAvailableArr == NULL) {
+		return -1;
+	}
+	availableNodeArr = newAvailableArr;
+
+	NODE *chunk = (NODE *)allocChunk(NODE_CHUNK_SIZE * sizeof(NODE));
+	if (chunk == NULL) {
+		return -1;
+	}
+	numNodeChunks++;
+
+	/* Push in reverse so the chunk is handed out in address order */
+	for (int i = NODE_CHUNK_SIZE - 1; i >= 0; i--) {
+		availableNodeArr[numNodesAvailable++] = &chunk[i];
+	}
+	return 0;
+}
+
+/**
+ * Add another chunk of lists to the list pool.
+ * Returns 0 on success, -1 if memory could not be allocated.
+ */
+static int growListPool(void) {
+	size_t newTotal = (size_t)(numListChunks + 1) * LIST_CHUNK_SIZE;
+	LIST **newAvailableArr = (LIST **)realloc(availableListArr, newTotal * sizeof(LIST *));
+	if (newAvailableArr == NULL) {
+		return -1;
+	}
+	availableListArr = newAvailableArr;
+
+	LIST *chunk = (LIST *)allocChunk(LIST_CHUNK_SIZE * sizeof(LIST));
+	if (chunk == NULL) {
+		return -1;
+	}
+	numListChunks++;
+
+	for (int i = LIST_CHUNK_SIZE - 1; i >= 0; i--) {
+		availableListArr[numListsAvailable++] = &chunk[i];
+	}
+	return 0;
+}
+
+/**
+ * Move a batch of nodes from the shared pool into this thread's cache, growing the pool if needed.
+ * Returns 0 on success, -1 if memory could not be allocated.
+ */
+static int refillNodeCache(void) {
+	pthread_mutex_lock(&poolLock);
+	if (numNodesAvailable < NODE_BATCH_SIZE && growNodePool() < 0 && numNodesAvailable == 0) {
+		pthread_mutex_unlock(&poolLock);
+		return -1;
+	}
+	int count = numNodesAvailable < NODE_BATCH_SIZE ? numNodesAvailable : NODE_BATCH_SIZE;
+	numNodesAvailable -= count;
+	memcpy(nodeCache, &availableNodeArr[numNodesAvailable], count * sizeof(NODE *));
+	pthread_mutex_unlock(&poolLock);
+
+	if (!cacheRegistered) {
+		registerThreadCache();
+	}
+	numNodesCached = count;
+	return 0;
+}
+
+/**
+ * Move a batch of lists from the shared pool into this thread's cache, growing the pool if needed.
+ * Returns 0 on success, -1 if memory could not be allocated.
+ */
+static int refillListCache(void) {
+	pthread_mutex_lock(&poolLock);
+	if (numListsAvailable < LIST_BATCH_SIZE && growListPool() < 0 && numListsAvailable == 0) {
+		pthread_mutex_unlock(&poolLock);
+		return -1;
+	}
+	int count = numListsAvailable < LIST_BATCH_SIZE ? numListsAvailable : LIST_BATCH_SIZE;
+	numListsAvailable -= count;
+	memcpy(listCache, &availableListArr[numListsAvailable], count * sizeof(LIST *));
+	pthread_mutex_unlock(&poolLock);
+
+	if (!cacheRegistered) {
+		registerThreadCache();
+	}
+	numListsCached = count;
+	return 0;
+}
+
+/**
+ * Move the count least recently freed nodes of this thread's cache back to the shared pool,
+ * keeping the ones most likely to still be in this core's cache.
+ * The pool's available array always has room, as it is sized for every node ever allocated.
+ */
+static void spillNodeCache(int count) {
+	pthread_mutex_lock(&poolLock);
+	memcpy(&availableNodeArr[numNodesAvailable], nodeCache, count * sizeof(NODE *));
+	numNodesAvailable += count;
+	pthread_mutex_unlock(&poolLock);
+
+	numNodesCached -= count;
+	memmove(nodeCache, &nodeCache[count], numNodesCached * sizeof(NODE *));
+}
+
+/**
+ * Move the count least recently freed lists of this thread's cache back to the shared pool.
+ */
+static void spillListCache(int count) {
+	pthread_mutex_lock(&poolLock);
+	memcpy(&availableListArr[numListsAvailable], listCache, count * sizeof(LIST *));
+	numListsAvailable += count;
+	pthread_mutex_unlock(&poolLock);
+
+	numListsCached -= count;
+	memmove(listCache, &listCache[count], numListsCached * sizeof(LIST *));
+}
+
+/**
+ * Mark the thread as having a cache to return when it exits, the first time it refills or frees
+ * into either cache. A thread that only frees what others allocated fills its cache too.
+ * The key's destructor only runs for a non-NULL value, which is all the value is for.
+ */
+static void registerThreadCache(void) {
+	pthread_setspecific(cacheKey, &cacheRegistered);
+	cacheRegistered = 1;
+}
+
+/**
+ * Return everything an exiting thread still has cached to the shared pool
+ */
+static void releaseThreadCache(void *unused) {
+	(void)unused;
+	spillNodeCache(numNodesCached);
+	spillListCache(numListsCached);
+}
+
+/**
+ * Pop a free node off the available stack, or this thread's cache in concurrent mode.
+ * Callers check NODE_POOL_FULL first.
+ */
+static NODE *allocNode(void) {
+	if (concurrentPools) {
+		return nodeCache[--numNodesCached];
+	}
+	return availableNodeArr[--numNodesAvailable];
+}
+
+/**
+ * Push a node back onto the available stack, or this thread's cache in concurrent mode.
+ * A full cache spills half, so alternating allocs and frees at the boundary don't each take the lock.
+ */
+static void freeNode(NODE *node) {
+	if (concurrentPools) {
+		if (!cacheRegistered) {
+			registerThreadCache();
+		}
+		if (numNodesCached == NODE_CACHE_SIZE) {
+			spillNodeCache(NODE_BATCH_SIZE);
+		}
+		nodeCache[numNodesCached++] = node;
+		return;
+	}
+	availableNodeArr[numNodesAvailable++] = node;
+}
+
+/**
+ * Pop a free list like allocNode. Callers check LIST_POOL_FULL first.
+ */
+static LIST *allocList(void) {
+	if (concurrentPools) {
+		return listCache[--numListsCached];
+	}
+	return availableListArr[--numListsAvailable];
+}
+
+/**
+ * Push a list back like freeNode
+ */
+static void freeList(LIST *list) {
+	if (concurrentPools) {
+		if (!cacheRegistered) {
+			registerThreadCache();
+		}
+		if (numListsCached == LIST_CACHE_SIZE) {
+			spillListCache(LIST_BATCH_SIZE);
+		}
+		listCache[numListsCached++] = list;
+		return;
+	}
+	availableListArr[numListsAvailable++] = list;
+}
+
 /**
  * Add item to empty list
  */
@@ -485,13 +847,12 @@ static void addItemToEmptyList(LIST *list, void *item) {
 	node.previous = NULL;
 	node.next = NULL;
 
-	int nodeIndex = availableNodeArr[numNodesAvailable - 1];
-	nodePool[nodeIndex] = node;
-	numNodesAvailable--;
+	NODE *newNode = allocNode();
+	*newNode = node;
 
-	list->current = &nodePool[nodeIndex];
-	list->head = &nodePool[nodeIndex];
-	list->tail = &nodePool[nodeIndex];
+	list->current = newNode;
+	list->head = newNode;
+	list->tail = newNode;
 	list->size++;
 }
 
@@ -509,16 +870,15 @@ static void addItemToListSizeOne(LIST *list, void *item, int afterHead) {
 		node.next = list->head;
 	}
 
-	int nodeIndex = availableNodeArr[numNodesAvailable - 1];
-	nodePool[nodeIndex] = node;
-	numNodesAvailable--;
+	NODE *newNode = allocNode();
+	*newNode = node;
 
-	list->current = &nodePool[nodeIndex];
+	list->current = newNode;
 	if (afterHead) {
-		list->head->next = &nodePool[nodeIndex];
-		list->tail = &nodePool[nodeIndex];
+		list->head->next = newNode;
+		list->tail = newNode;
 	} else {
-		list->head = &nodePool[nodeIndex];
+		list->head = newNode;
 		list->tail = list->head->next;
 		list->tail->previous = list->head;
 	}
@@ -535,14 +895,13 @@ static void addItemBetweenTwoOthers(LIST *list, void *item, NODE *pre, NODE *pos
 	node.previous = pre;
 	node.next = post;
 
-	int nodeIndex = availableNodeArr[numNodesAvailable - 1];
-	nodePool[nodeIndex] = node;
-	numNodesAvailable--;
+	NODE *newNode = allocNode();
+	*newNode = node;
 	
-	pre->next = &nodePool[nodeIndex];
-	post->previous = &nodePool[nodeIndex];
+	pre->next = newNode;
+	post->previous = newNode;
 
-	list->current = &nodePool[nodeIndex];
+	list->current = newNode;
 	list->size++;
 	list->currentIsBeyond = 0;
 }
\ No newline at end of file
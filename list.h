@@ -1,6 +1,8 @@
 #ifndef _LIST_H_
 #define _LIST_H_
 
+#include <stddef.h>
+
 /**
  * Structs
  */
@@ -17,6 +19,32 @@ typedef struct LIST {
 	int currentIsBeyond; // 0 if current is not beyond the list boundaries, -1 if before, 1 if after
 } LIST;
 
+/**
+ * Intrusive list. The LINK is embedded in the item itself, so adding and removing an item
+ * only touches the item and its neighbours and never allocates.
+ */
+typedef struct LINK {
+	struct LINK *previous;
+	struct LINK *next;
+} LINK;
+typedef struct ILIST {
+	LINK *head;
+	LINK *tail;
+	int size;
+} ILIST;
+
+/* Counts of the memory behind the node and list pools */
+typedef struct LIST_POOL_STATS {
+	long nodeChunks;		// Node chunks allocated so far
+	long listChunks;		// List chunks allocated so far
+	long nodesAvailable;	// Free nodes in the pool
+	long listsAvailable;	// Free lists in the pool
+} LIST_POOL_STATS;
+
+/* Get the item containing a link, e.g. LINK_ITEM(link, PROCESS, queueLink) */
+#define LINK_ITEM(link, type, member) ((type *)((char *)(link) - offsetof(type, member)))
+#define ILIST_FOR_EACH(link, list) for (LINK *link = (list)->head; link != NULL; link = link->next)
+
 /**
  * Function prototypes
  */
@@ -36,5 +64,16 @@ void ListConcat(LIST *list1, LIST *list2);
 void ListFree(LIST *list, void (*itemFree)(void *));
 void *ListTrim(LIST *list);
 void *ListSearch(LIST *list, int (*comparator)(void *, void *), void *comparisonArg);
+void ListPoolStats(LIST_POOL_STATS *stats);
+int ListPoolEnableConcurrency(void);
+
+void IListInit(ILIST *list);
+int IListCount(ILIST *list);
+LINK *IListFirst(ILIST *list);
+void IListAppend(ILIST *list, LINK *link);
+void IListPrepend(ILIST *list, LINK *link);
+void IListInsertAfter(ILIST *list, LINK *after, LINK *link);
+void IListRemove(ILIST *list, LINK *link);
+LINK *IListPop(ILIST *list);
 
 #endif /* _LIST_H_ */
\ No newline at end of file
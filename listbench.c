@@ -0,0 +1,384 @@
+/***************************************************************
+ * Microbenchmarks for the list module                         *
+ * Usage: listbench [max_list_size] [max_threads]              *
+ * Prints CSV to stdout, one row per operation, pattern and    *
+ * list size.                                                  *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "list.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+/***************************************************************
+ * Defines and Constants                                       *
+ ***************************************************************/
+#define MAX_LIST_SIZE	100000
+#define MIN_OPS			1000000	// Each benchmark repeats until at least this many operations
+#define MAX_SEEK_OPS	1000	// Cap per round on operations that walk the list to a random position
+#define CONCAT_LISTS	1000	// Lists joined per round of the concat benchmark
+#define MAX_THREADS		64
+static const int SIZES[] = {10, 100, 1000, 10000, MAX_LIST_SIZE};
+
+/***************************************************************
+ * Statics                                                     *
+ ***************************************************************/
+static int items[MAX_LIST_SIZE];
+static unsigned int randomState = 12345;
+
+/***************************************************************
+ * Function Prototypes                                         *
+ ***************************************************************/
+static long long NowNs();
+static long ChunkAllocs();
+static unsigned int NextRandom();
+static int Rounds(int size);
+static LIST *BuildList(int size);
+static void Report(const char *operation, const char *pattern, int size,
+	long ops, long long ns, long allocs);
+static int PointerComparator(void *item, void *target);
+
+static void BenchAppend(int size);
+static void BenchPrepend(int size);
+static void BenchInsert(int size);
+static void BenchRemoveFifo(int size);
+static void BenchTrimLifo(int size);
+static void BenchRemoveRandom(int size);
+static void BenchConcat(int size);
+static void BenchSearch(int size);
+static void BenchFree(int size);
+static void BenchThreads(int size, int numThreads);
+static void *ThreadChurn(void *arg);
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * With max_threads, the single-threaded benchmarks are followed by ones where 1, 2, 4... up to
+ * max_threads threads each churn lists of their own, using the concurrent allocator mode.
+ */
+int main(int argc, char *argv[]) {
+	int maxSize = argc > 1 ? atoi(argv[1]) : MAX_LIST_SIZE;
+	int maxThreads = argc > 2 ? atoi(argv[2]) : 0;
+	if (maxSize <= 0 || maxSize > MAX_LIST_SIZE || maxThreads < 0 || maxThreads > MAX_THREADS) {
+		fprintf(stderr, "Usage: %s [max_list_size (1-%d)] [max_threads (0-%d)]\n", argv[0], 
+			MAX_LIST_SIZE, MAX_THREADS);
+		return 1;
+	}
+
+	printf("operation,pattern,size,ops,ns_per_op,chunk_allocs\n");
+	for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]) && SIZES[i] <= maxSize; i++) {
+		int size = SIZES[i];
+		BenchAppend(size);
+		BenchPrepend(size);
+		BenchInsert(size);
+		BenchRemoveFifo(size);
+		BenchTrimLifo(size);
+		BenchRemoveRandom(size);
+		BenchConcat(size);
+		BenchSearch(size);
+		BenchFree(size);
+	}
+
+	if (maxThreads > 0) {
+		if (ListPoolEnableConcurrency() < 0) {
+			fprintf(stderr, "Failed to enable the concurrent allocator mode.\n");
+			return 1;
+		}
+		for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]) && SIZES[i] <= maxSize; i++) {
+			for (int threads = 1; threads < maxThreads; threads *= 2) {
+				BenchThreads(SIZES[i], threads);
+			}
+			BenchThreads(SIZES[i], maxThreads);
+		}
+	}
+	return 0;
+}
+
+/***************************************************************
+ * Benchmarks                                                  *
+ ***************************************************************/
+
+/* Append to the tail of an empty list until it holds size items */
+static void BenchAppend(int size) {
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < Rounds(size); round++) {
+		LIST *list = ListCreate();
+		long long start = NowNs();
+		for (int i = 0; i < size; i++) {
+			ListAppend(list, &items[i]);
+		}
+		ns += NowNs() - start;
+		ops += size;
+		ListFree(list, NULL);
+	}
+	Report("ListAppend", "tail", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Prepend to the head of an empty list until it holds size items */
+static void BenchPrepend(int size) {
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < Rounds(size); round++) {
+		LIST *list = ListCreate();
+		long long start = NowNs();
+		for (int i = 0; i < size; i++) {
+			ListPrepend(list, &items[i]);
+		}
+		ns += NowNs() - start;
+		ops += size;
+		ListFree(list, NULL);
+	}
+	Report("ListPrepend", "head", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Insert repeatedly before the current item, starting between two existing items */
+static void BenchInsert(int size) {
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < Rounds(size); round++) {
+		LIST *list = BuildList(2);
+		ListFirst(list);
+		ListNext(list);
+		long long start = NowNs();
+		for (int i = 0; i < size; i++) {
+			ListInsert(list, &items[i]);
+		}
+		ns += NowNs() - start;
+		ops += size;
+		ListFree(list, NULL);
+	}
+	Report("ListInsert", "middle", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Remove from the head until the list is empty, as a FIFO queue would */
+static void BenchRemoveFifo(int size) {
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < Rounds(size); round++) {
+		LIST *list = BuildList(size);
+		ListFirst(list);
+		long long start = NowNs();
+		for (int i = 0; i < size; i++) {
+			ListRemove(list);
+		}
+		ns += NowNs() - start;
+		ops += size;
+		ListFree(list, NULL);
+	}
+	Report("ListRemove", "fifo", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Trim from the tail until the list is empty, as a LIFO stack would */
+static void BenchTrimLifo(int size) {
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < Rounds(size); round++) {
+		LIST *list = BuildList(size);
+		long long start = NowNs();
+		for (int i = 0; i < size; i++) {
+			ListTrim(list);
+		}
+		ns += NowNs() - start;
+		ops += size;
+		ListFree(list, NULL);
+	}
+	Report("ListTrim", "lifo", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Walk to a random position and remove the item there. The time includes the walk. */
+static void BenchRemoveRandom(int size) {
+	int removals = size < MAX_SEEK_OPS ? size : MAX_SEEK_OPS;
+	int rounds = Rounds(size) / removals > 0 ? Rounds(size) / removals : 1;
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < rounds; round++) {
+		LIST *list = BuildList(size);
+		long long start = NowNs();
+		for (int i = 0; i < removals; i++) {
+			int position = NextRandom() % ListCount(list);
+			ListFirst(list);
+			for (int j = 0; j < position; j++) {
+				ListNext(list);
+			}
+			ListRemove(list);
+		}
+		ns += NowNs() - start;
+		ops += removals;
+		ListFree(list, NULL);
+	}
+	Report("ListRemove", "random", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Join many lists of the given size onto the first one */
+static void BenchConcat(int size) {
+	static LIST *lists[CONCAT_LISTS];
+	int numLists = MIN_OPS / size < CONCAT_LISTS ? MIN_OPS / size : CONCAT_LISTS;
+	numLists = numLists < 2 ? 2 : numLists;
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < Rounds(size * numLists); round++) {
+		for (int i = 0; i < numLists; i++) {
+			lists[i] = BuildList(size);
+		}
+		long long start = NowNs();
+		for (int i = 1; i < numLists; i++) {
+			ListConcat(lists[0], lists[i]);
+		}
+		ns += NowNs() - start;
+		ops += numLists - 1;
+		ListFree(lists[0], NULL);
+	}
+	Report("ListConcat", "append_list", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Search from the head for a randomly chosen item */
+static void BenchSearch(int size) {
+	int searches = size < MAX_SEEK_OPS ? size : MAX_SEEK_OPS;
+	int rounds = Rounds(size) / searches > 0 ? Rounds(size) / searches : 1;
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < rounds; round++) {
+		LIST *list = BuildList(size);
+		long long start = NowNs();
+		for (int i = 0; i < searches; i++) {
+			ListFirst(list);
+			ListSearch(list, PointerComparator, &items[NextRandom() % size]);
+		}
+		ns += NowNs() - start;
+		ops += searches;
+		ListFree(list, NULL);
+	}
+	Report("ListSearch", "random", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/* Free a whole list. Reported per item freed. */
+static void BenchFree(int size) {
+	long long ns = 0;
+	long ops = 0;
+	long allocs = ChunkAllocs();
+
+	for (int round = 0; round < Rounds(size); round++) {
+		LIST *list = BuildList(size);
+		long long start = NowNs();
+		ListFree(list, NULL);
+		ns += NowNs() - start;
+		ops += size;
+	}
+	Report("ListFree", "whole_list", size, ops, ns, ChunkAllocs() - allocs);
+}
+
+/**
+ * Each thread appends size items to a list of its own then removes them from the head, for as many
+ * rounds as the single-threaded benchmarks. Reported per operation across all threads, by wall time,
+ * so perfect scaling keeps ns_per_op falling as threads are added.
+ */
+static void BenchThreads(int size, int numThreads) {
+	pthread_t threads[MAX_THREADS];
+	char pattern[32];
+	long allocs = ChunkAllocs();
+
+	long long start = NowNs();
+	for (int i = 0; i < numThreads; i++) {
+		pthread_create(&threads[i], NULL, ThreadChurn, (void *)(long)size);
+	}
+	for (int i = 0; i < numThreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	long long ns = NowNs() - start;
+
+	snprintf(pattern, sizeof(pattern), "threads_%d", numThreads);
+	Report("ListAppend+ListRemove", pattern, size, 2L * size * Rounds(size) * numThreads, ns, 
+		ChunkAllocs() - allocs);
+}
+
+/* Thread body for BenchThreads */
+static void *ThreadChurn(void *arg) {
+	int size = (int)(long)arg;
+	for (int round = 0; round < Rounds(size); round++) {
+		LIST *list = ListCreate();
+		for (int i = 0; i < size; i++) {
+			ListAppend(list, &items[i]);
+		}
+		ListFirst(list);
+		for (int i = 0; i < size; i++) {
+			ListRemove(list);
+		}
+		ListFree(list, NULL);
+	}
+	return NULL;
+}
+
+/***************************************************************
+ * Helper Functions                                            *
+ ***************************************************************/
+
+/* Returns a monotonic timestamp in nanoseconds */
+static long long NowNs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Returns the number of chunks the list module has allocated so far */
+static long ChunkAllocs() {
+	LIST_POOL_STATS stats;
+	ListPoolStats(&stats);
+	return stats.nodeChunks + stats.listChunks;
+}
+
+/* Small deterministic xorshift generator, so every run uses the same pattern */
+static unsigned int NextRandom() {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+/* Number of rounds needed for a benchmark doing size operations per round to reach MIN_OPS */
+static int Rounds(int size) {
+	return size >= MIN_OPS ? 1 : MIN_OPS / size;
+}
+
+/* Creates a list holding the first size items, in order */
+static LIST *BuildList(int size) {
+	LIST *list = ListCreate();
+	for (int i = 0; i < size; i++) {
+		ListAppend(list, &items[i % MAX_LIST_SIZE]);
+	}
+	return list;
+}
+
+/* Prints one CSV row */
+static void Report(const char *operation, const char *pattern, int size,
+		long ops, long long ns, long allocs) {
+	printf("%s,%s,%d,%ld,%.2f,%ld\n", operation, pattern, size, ops,
+		ops > 0 ? (double)ns / ops : 0.0, allocs);
+}
+
+/* Returns 1 if the item is the target pointer, 0 otherwise */
+static int PointerComparator(void *item, void *target) {
+	return item == target;
+}
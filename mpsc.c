@@ -0,0 +1,48 @@
+/***************************************************************
+ * Lock-free multi-producer, single-consumer link queue        *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "mpsc.h"
+#include <stdatomic.h>
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+void MpscInit(MPSC_QUEUE *queue) {
+	atomic_init(&queue->top, NULL);
+}
+
+/**
+ * Queues a link. Safe to call from any number of threads at once.
+ * Only the link's next pointer is used while it is queued.
+ */
+void MpscPush(MPSC_QUEUE *queue, LINK *link) {
+	LINK *top = atomic_load_explicit(&queue->top, memory_order_relaxed);
+	do {
+		link->next = top;
+	} while (!atomic_compare_exchange_weak_explicit(&queue->top, &top, link,
+		memory_order_release, memory_order_relaxed));
+}
+
+/**
+ * Takes every link queued so far. Must only be called by the consumer.
+ * Returns the oldest link, with the rest following it in push order through next,
+ * or NULL if the queue was empty.
+ */
+LINK *MpscTakeAll(MPSC_QUEUE *queue) {
+	LINK *link = atomic_exchange_explicit(&queue->top, NULL, memory_order_acquire);
+
+	/* Links were chained newest first, so reverse them */
+	LINK *oldest = NULL;
+	while (link != NULL) {
+		LINK *next = link->next;
+		link->next = oldest;
+		oldest = link;
+		link = next;
+	}
+	return oldest;
+}
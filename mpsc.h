@@ -0,0 +1,29 @@
+#ifndef _MPSC_H_
+#define _MPSC_H_
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "list.h"
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/**
+ * Lock-free multi-producer, single-consumer queue of intrusive links.
+ * Any thread can push; one consumer takes everything queued so far in a single exchange,
+ * so producers never wait on each other or on the consumer.
+ */
+typedef struct MPSC_QUEUE {
+	LINK *_Atomic top;	// Most recently pushed link, chained through next
+} MPSC_QUEUE;
+
+/***************************************************************
+ * Function prototypes                                         *
+ ***************************************************************/
+void MpscInit(MPSC_QUEUE *queue);
+void MpscPush(MPSC_QUEUE *queue, LINK *link);
+LINK *MpscTakeAll(MPSC_QUEUE *queue);
+
+#endif /* _MPSC_H_ */
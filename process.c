@@ -8,92 +8,420 @@
  * Imports                                                     *
  ***************************************************************/
 #include "process.h"
+#include "sched.h"
+#include "trace.h"
+#include "mpsc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/resource.h>
 
 /***************************************************************
  * Defines and Constants                                       *
  ***************************************************************/
 #define TERMINAL_FD		0
 #define BUF_SIZE		500
-#define NUM_SEMAPHORES	5
-#define MAX_MSG_LEN		40
+#define READ_BLOCK_SIZE	(64 * 1024)
+#define OUTPUT_BUF_SIZE	(1024 * 1024)
+#define MAX_SEMAPHORES	(1 << 20)	// Semaphore IDs run from 0 to MAX_SEMAPHORES - 1
+#define SEMAPHORE_TABLE_INIT_SIZE	8
+#define PID_TABLE_INIT_SIZE	64
+#define DEFAULT_MSG_QUEUE_CAPACITY	32	// Messages a process can have queued, see MsgQueueFull
+#define MSG_CHUNK_SIZE		64	// Message slots allocated at a time when the pool runs dry
+#define CACHE_LINE_SIZE		64
+#define CPU_BATCH_MIN_QUANTA	32		// Shorter runs of quanta are expired on the command thread
+#define CPU_BATCH_MAX_QUANTA	4096	// Most quanta the CPU threads run between two barriers
+#define BATCH_PHASES		3	// Pre-empt, pick locally, fall back to the idle process
+#define IDLE_PID			-1	// PID shown for the idle processes of CPUs other than CPU 0
+#define NOT_WOKEN			ULONG_MAX	// wokenAt of a process that isn't waiting to run after a wakeup
+#define NOT_INVERTED		ULONG_MAX	// invertedSince of a semaphore no higher priority process waits on
+#define WORKLOAD_MSG		"workload message\n"	// Typed messages keep their newline too
+#define WORKLOAD_REPLY		"workload reply\n"
+
+/* States a process only leaves when another process acts, which a workload can wait in forever */
+#define WAITS_ON_PROCESS(state)	((state) == BLOCKED_SEM || (state) == BLOCKED_SEND || (state) == BLOCKED_RCV)
+
+/**
+ * Narration is printed only at or above the given verbosity.
+ * Below that, the hot paths pay a single branch and no formatting.
+ * CPU threads print into their own buffer, which is written out in CPU order.
+ */
+#define VERBOSITY_SILENT	0
+#define VERBOSITY_ERRORS	1
+#define VERBOSITY_NORMAL	2
+#define LOG_STREAM			(cpuThread != NULL ? cpuThread->logStream : stdout)
+#define LOG(...)			do { if (verbosity >= VERBOSITY_NORMAL) fprintf(LOG_STREAM, __VA_ARGS__); } while (0)
+#define LOG_ERROR(...)		do { if (verbosity >= VERBOSITY_ERRORS) fprintf(LOG_STREAM, __VA_ARGS__); } while (0)
+
+/* Every event goes into the trace ring; it is only formatted when -e is given */
+#define EMIT_EVENT(type, pid, arg)	do { \
+		TRACE_RECORD eventRecord = TraceRecord(type, pid, arg); \
+		if (eventOutput) PrintEvent(&eventRecord); \
+	} while (0)
+
 static const char * const PRIORITIES[4] = {"HIGH", "NORMAL", "LOW", "INIT"};
-static const char * const STATES[5] = 
-	{"RUNNING", "READY", "SEM BLOCKED", "SEND BLOCKED", "RECEIVE BLOCKED"};
+static const char * const STATES[6] = 
+	{"RUNNING", "READY", "SEM BLOCKED", "SEND BLOCKED", "RECEIVE BLOCKED", "SLEEPING"};
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/* How semaphores treat the priorities of their owners and waiters, picked with -I */
+typedef enum SEM_PROTOCOL {
+	SEM_NONE,		// Blocked processes wait in FIFO order and priorities never change
+	SEM_INHERIT,	// Blocked processes wait in priority order and lend their priority to the owner
+	SEM_CEILING,	// As SEM_INHERIT, and an owner runs at the semaphore's priority ceiling straight away
+	NUM_SEM_PROTOCOLS
+} SEM_PROTOCOL;
+
+static const char * const SEM_PROTOCOLS[NUM_SEM_PROTOCOLS] = {"none", "inherit", "ceiling"};
+
+/**
+ * Messages and replies in flight that arrive on the same tick. The delay is the same for all
+ * of them, so they were sent on the same tick too, and share one timer.
+ */
+typedef struct DELIVERY {
+	TIMER timer;	// Fires at the tick they arrive at
+	ILIST msgs;		// In the order they were sent, linked through link
+	LINK link;		// Position in deliveryFreeList while unused
+} DELIVERY;
+
+/* Host thread driving one CPU in threaded mode (-T) */
+typedef struct CPU_THREAD {
+	pthread_t thread;
+	CPU *cpu;
+	FILE *logStream;	// What the thread printed since the command thread last wrote it out
+	char *logBuffer;
+	size_t logLength;
+	size_t *phaseEnds;	// Length of the log at the end of each phase of each quantum in the batch
+} CPU_THREAD;
 
 /***************************************************************
  * Statics                                                     *
  ***************************************************************/
-static LIST *highReadyQueue;
-static LIST *normalReadyQueue;
-static LIST *lowReadyQueue;
-static LIST *blockedQueue;
-static LIST *msgQueue;
+static const SCHED_POLICY *policy = NULL;
+static const SCHED_POLICY *rtPolicy = NULL;	// Orders the real-time tasks, which run before the rest
+static SEM_PROTOCOL semProtocol = SEM_NONE;
+static ILIST sendBlockedQueue;	// Processes waiting for a reply
+static ILIST rcvBlockedQueue;	// Processes waiting for a message
+static int numSemBlocked = 0;	// Processes waiting on a semaphore, which are only on its blockedList
+static int numSleeping = 0;		// Sleeping processes, which are only on the timer wheel
+static int numRtTasks = 0;		// Live real-time tasks
+static unsigned long rtJobsDone = 0;	// Jobs finished by every real-time task, killed ones included
+static unsigned long rtMisses = 0;		// Of those, the ones that finished after their deadline
 static PROCESS *initProcess = NULL;
-static PROCESS *runningProcess = NULL;
-static SEMAPHORE *semaphoreArr[NUM_SEMAPHORES] = {NULL};
+static CPU *cpus = NULL;
+static int numCpus = 1;
+static CPU *currentCpu = NULL;	// CPU that commands act on, switched with the use command
+static CPU_THREAD *cpuThreads = NULL;	// One per CPU in threaded mode, NULL otherwise
+static unsigned long batchFirstTick = 0;	// Tick of the first quantum the CPU threads run ahead
+static unsigned long batchQuanta = 0;	// Quanta in the batch
+static unsigned long quantaBatched = 0;	// Quanta run ahead on the CPU threads, for -S
+static unsigned long numBatches = 0;
+static unsigned long quantaInline = 0;	// Quanta expired one at a time on the command thread
+static pthread_barrier_t cpuWorkStart;
+static pthread_barrier_t cpuWorkDone;
+static __thread CPU_THREAD *cpuThread = NULL;	// The CPU thread running this code, NULL on the command thread
+static MPSC_QUEUE msgReturnQueue;	// Message slots freed on CPU threads, not yet back in msgFreeList
+static SEMAPHORE **semaphoreTable = NULL;	// Semaphores indexed by ID, NULL if not initialized
+static int semaphoreTableSize = 0;
 static char inputBuffer[BUF_SIZE];
+static char readBlock[READ_BLOCK_SIZE];	// Raw input, may hold many commands or part of one
+static size_t readPos = 0;
+static size_t readLen = 0;
+static int inputFd = TERMINAL_FD;
+static char outputBuffer[OUTPUT_BUF_SIZE];
+static int verbosity = VERBOSITY_NORMAL;
+static int eventOutput = 0;	// Print one line per scheduler event
+static long commandsRun = 0;
+static int numLiveProcesses = 0;
+static struct timespec runStartTime;
 static int nextAvailPid = 0;
+/* Logical clock, advanced by the quantum and run commands. CPU threads keep their own copy,
+ * set to the tick of the quantum they are running ahead. */
+static __thread unsigned long clockTick = 0;
+static TIMER_WHEEL timerWheel;	// Everything due at a later tick: quanta, sleeps, timeouts, deliveries
+static TIMER quantumTimer;
+static unsigned long quantumTicks = 1;	// Ticks a quantum lasts under the run command
+static unsigned long msgDelay = 0;		// Ticks a message takes to reach its receiver
+static WORKLOAD workload;		// Loaded with -W
+static int *workloadPids = NULL;	// PID of each workload process once it arrives, NULL without -W
+static uint32_t nextArrival = 0;	// Index of the next workload process to arrive
+static TIMER arrivalTimer;
+static int workloadLive = 0;	// Workload processes that have arrived and not exited
+static int workloadWaiting = 0;	// Of those, the ones waiting on another process
+static PROCESS **pidTable = NULL;	// Live processes indexed by PID, NULL once killed
+static int pidTableSize = 0;
+static ILIST msgFreeList;	// Recycled message slots, most recently freed first
+static long msgChunks = 0;
+static DELIVERY *lastDelivery = NULL;	// Delivery of the last message sent in flight, which may be over
+static ILIST deliveryFreeList;	// Deliveries whose messages have all arrived
+static int msgQueueCapacity = DEFAULT_MSG_QUEUE_CAPACITY;
 
 /***************************************************************
  * Function Prototypes                                         *
  ***************************************************************/
 static int Create(int priority);
+static int CreateRealTime(long period, long wcet, long deadline);
 static int Fork();
 static int Kill(int pid);
 static int Quantum();
-static int NewSemaphore(int id, int value);
-static void P(int id);
+static void ExpireQuantum();
+static void RunFor(long ticks);
+static void AdvanceClock(unsigned long until);
+static void SleepProcess(long ticks);
+static int NewSemaphore(int id, int value, int ceiling);
+static int DestroySemaphore(int id);
+static void P(int id, long timeout);
 static void V(int id);
-static void Send();
-static void Receive();
+static void Send(int waitForReply);
+static void SendMsg(int pid, const char *text, int waitForReply);
+static void Receive(int maxMsgs, int mayBlock);
 static void Reply();
+static void ReplyMsg(int pid, const char *text);
 static void ProcInfo(int pid);
 static void TotalInfo();
-
-static void SelectNewRunningProcess();
+static void PrintLatencies(FILE *out);
+static void PrintLatencyRow(FILE *out, const char *kind, const char *priority, const HISTOGRAM *hist);
+static void PrintRealTime();
+
+static void SelectNewRunningProcess(CPU *cpu);
+static void DispatchProcess(CPU *cpu, PROCESS *newRunningProc);
+static void PreemptCpu(CPU *cpu);
+static void PickLocalProcess(CPU *cpu);
+static int RunQuantaOnCpuThreads(unsigned long until);
+static unsigned long BatchableQuanta(unsigned long until);
+static void RunBatchOnCpu(CPU_THREAD *thread);
+static int StartCpuThreads();
+static void *CpuThreadMain(void *arg);
+static unsigned long TotalContextSwitches();
+static PROCESS *StealProcess(CPU *thief);
+static CPU *LeastLoadedCpu();
+static int TotalReadyProcesses();
+static int RunnableProcesses(CPU *cpu);
+static PROCESS *PickLocalNext(CPU *cpu);
+static int InitCpus();
+static void SetProcessState(PROCESS *process, STATE state);
+static unsigned long TimeInState(PROCESS *process, STATE state);
 static void AddProcessToReadyQueue(PROCESS *process);
-static int PidComparator(void *proc1, void *proc2);
-static int MsgComparator(void *msg1, void *msg2);
+static int RegisterProcess(PROCESS *process);
+static void DestroyProcess(PROCESS *process);
+static void EnqueueProcess(ILIST *queue, PROCESS *process);
+static void DequeueProcess(PROCESS *process);
 static PROCESS *GetProcByPid(int pid);
+static SEMAPHORE *GetSemaphore(int id);
 static int FindProcByPidAndDelete(int pid);
-static void RemovePidFromBlockedQueue(PROCESS *process);
-static PROCESS *SearchBlockedQueue(int pid);
-static void HandleMsgIfReceived();
+static void RemoveFromBlockedQueue(PROCESS *process);
+static void UnblockFromSemaphore(PROCESS *process);
+static void InsertWaiter(SEMAPHORE *semaphore, PROCESS *process);
+static void TakeSemaphore(SEMAPHORE *semaphore, PROCESS *process);
+static PROCESS *DisownSemaphore(SEMAPHORE *semaphore);
+static void UpdatePriority(PROCESS *process);
+static void SetEffectivePriority(PROCESS *process, PRIORITY priority);
+static void CheckInversion(SEMAPHORE *semaphore);
+static int NumBlockedProcesses();
+static int MsgQueueFull(PROCESS *process);
+static void HandleMsgIfReceived(PROCESS *process);
+static void DeliverMsg(PROCESS *rcvProcess, MSG *msg);
+static void QuantumTimerFired(TIMER *timer);
+static void SleepTimerFired(TIMER *timer);
+static void SemTimeoutFired(TIMER *timer);
+static void MsgDeliveryFired(TIMER *timer);
+static int PutInFlight(MSG *msg);
+static int LoadWorkload(const char *path);
+static void AdmitArrivals();
+static void StepWorkload();
+static int RunProcessSteps(CPU *cpu);
+static void StartStep(PROCESS *process);
+static void ChargeBurst(PROCESS *process);
+static void RunWorkloadToEnd();
+static void ArrivalTimerFired(TIMER *timer);
+static void BurstTimerFired(TIMER *timer);
+static void ReleaseTimerFired(TIMER *timer);
+static void StartJob(PROCESS *task);
+static void FinishJob(PROCESS *task);
+static void PreemptForJob(PROCESS *task);
+static CPU *LeastRtUtilizedCpu();
+static double RtUtilization(int cpuId, double *density, double *hyperbolic, int *implicit);
+static unsigned long LateJobs(PROCESS *task);
+static MSG *NewMsg(MSG_TYPE type, int sendPid, int rcvPid, const char *text);
+static int GrowMsgPool();
+static void FreeMsg(MSG *msg);
+static int ReadCommand();
+static void PrintEvent(const TRACE_RECORD *record);
+static void DumpTrace();
+static void PrintRunStats();
 
 /***************************************************************
  * Global Functions                                            *
  ***************************************************************/
 
-int main(void) {
-	printf("\n********** Welcome **********\n");
+int main(int argc, char *argv[]) {
+	/**
+	 * Batch mode (-b file, or -b - for stdin) runs a command script back-to-back.
+	 * Output is fully buffered so large scripts aren't slowed down by a write per line.
+	 * -v sets the verbosity (0 silent, 1 errors only, 2 everything).
+	 * -e prints a structured line for every scheduler event.
+	 * -S prints throughput and memory statistics to stderr when the simulation ends.
+	 * -m sets how many messages each process can have queued before sends to it fail.
+	 * -P picks the scheduling policy: rr (default), mlfq, stride or cfs.
+	 * -c sets the number of simulated CPUs (default 1).
+	 * -T drives each simulated CPU from its own host thread during long runs of quanta.
+	 * -Q sets how many ticks a quantum lasts when the run command advances the clock (default 1).
+	 * -D sets how many ticks a message or reply takes to be delivered (default 0).
+	 * -W streams the processes of a workload file through the scheduler as the clock advances.
+	 * -R picks how real-time tasks are ordered: edf (default) or rm.
+	 * -I picks the semaphore protocol: none (default), inherit or ceiling.
+	 */
+	int opt;
+	int threaded = 0;
+	const char *workloadPath = NULL;
+	policy = SchedFindPolicy("rr");
+	rtPolicy = SchedFindRtPolicy("edf");
+	while ((opt = getopt(argc, argv, "b:v:eSm:P:c:TQ:D:W:R:I:")) != -1) {
+		switch (opt) {
+			case 'b':
+				if (strcmp(optarg, "-") != 0) {
+					inputFd = open(optarg, O_RDONLY);
+					if (inputFd < 0) {
+						perror(optarg);
+						return -1;
+					}
+				}
+				setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+				break;
+			case 'v':
+				verbosity = atoi(optarg);
+				break;
+			case 'e':
+				eventOutput = 1;
+				break;
+			case 'S':
+				atexit(PrintRunStats);
+				break;
+			case 'm':
+				msgQueueCapacity = atoi(optarg);
+				if (msgQueueCapacity < 1) {
+					fprintf(stderr, "The message queue capacity must be at least 1.\n");
+					return -1;
+				}
+				break;
+			case 'P':
+				policy = SchedFindPolicy(optarg);
+				if (policy == NULL) {
+					fprintf(stderr, "Unknown scheduling policy '%s'. Use rr, mlfq, stride or cfs.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'c':
+				numCpus = atoi(optarg);
+				if (numCpus < 1 || numCpus > MAX_CPUS) {
+					fprintf(stderr, "The number of CPUs must be between 1 and %d.\n", MAX_CPUS);
+					return -1;
+				}
+				break;
+			case 'T':
+				threaded = 1;
+				break;
+			case 'Q':
+				if (atol(optarg) < 1) {
+					fprintf(stderr, "A quantum must last at least 1 tick.\n");
+					return -1;
+				}
+				quantumTicks = (unsigned long)atol(optarg);
+				break;
+			case 'D':
+				if (atol(optarg) < 0) {
+					fprintf(stderr, "The message delay can't be negative.\n");
+					return -1;
+				}
+				msgDelay = (unsigned long)atol(optarg);
+				break;
+			case 'W':
+				workloadPath = optarg;
+				break;
+			case 'R':
+				rtPolicy = SchedFindRtPolicy(optarg);
+				if (rtPolicy == NULL) {
+					fprintf(stderr, "Unknown real-time policy '%s'. Use edf or rm.\n", optarg);
+					return -1;
+				}
+				break;
+			case 'I':
+				semProtocol = NUM_SEM_PROTOCOLS;
+				for (int i = 0; i < NUM_SEM_PROTOCOLS; i++) {
+					if (strcmp(optarg, SEM_PROTOCOLS[i]) == 0) {
+						semProtocol = (SEM_PROTOCOL)i;
+					}
+				}
+				if (semProtocol == NUM_SEM_PROTOCOLS) {
+					fprintf(stderr, "Unknown semaphore protocol '%s'. Use none, inherit or ceiling.\n", optarg);
+					return -1;
+				}
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-b command_file] [-v verbosity] [-e] [-S] [-m queue_capacity] "
+					"[-P policy] [-c cpus] [-T] [-Q quantum_ticks] [-D msg_delay] [-W workload] "
+					"[-R rt_policy] [-I sem_protocol]\n", argv[0]);
+				return -1;
+		}
+	}
+	TraceInit();
+	clock_gettime(CLOCK_MONOTONIC, &runStartTime);
+
+	LOG("\n********** Welcome **********\n");
 
 	/* Init ready queue list structures */
-	printf("Initializing queues...\n");
-	highReadyQueue = ListCreate();
-	normalReadyQueue = ListCreate();
-	lowReadyQueue = ListCreate();
-	blockedQueue = ListCreate();
-	msgQueue = ListCreate();
-
-	printf("The INIT process will be created...\n");
+	LOG("Initializing queues...\n");
+	IListInit(&sendBlockedQueue);
+	IListInit(&rcvBlockedQueue);
+	IListInit(&msgFreeList);
+	IListInit(&deliveryFreeList);
+	MpscInit(&msgReturnQueue);
+	TimerWheelInit(&timerWheel, clockTick);
+	TimerInit(&quantumTimer, QuantumTimerFired);
+
+	if (InitCpus() < 0) {
+		fprintf(stderr, "Out of memory for the CPUs.\n");
+		return -1;
+	}
+
+	LOG("The INIT process will be created...\n");
 	if (Create(INIT) < 0) {
 		return -1;
 	}
-	initProcess->state = RUNNING;
-	printf("********** Ready for commands **********\n\n");
+	SetProcessState(initProcess, RUNNING);
+	cpus[0].idle = initProcess;
+	cpus[0].running = initProcess;
+	TimerAdd(&timerWheel, &quantumTimer, clockTick + quantumTicks);
+	if (threaded && StartCpuThreads() < 0) {
+		fprintf(stderr, "Failed to start the CPU threads.\n");
+		return -1;
+	}
+	if (workloadPath != NULL && LoadWorkload(workloadPath) < 0) {
+		return -1;
+	}
+	LOG("********** Ready for commands **********\n\n");
 
-	/* Infinite loop to read terminal commands */
+	/* Loop to read commands until the input runs out */
 	while (1) {
 		char *pidChars = NULL;
 		int pid = 0;
 
 		memset(inputBuffer, 0, sizeof(inputBuffer));
-		read(TERMINAL_FD, inputBuffer, BUF_SIZE);
+		if (ReadCommand() < 0) {
+			RunWorkloadToEnd();
+			LOG("End of input. Goodbye.\n");
+			return 0;
+		}
+		commandsRun++;
 
 		/**
 		 * Get the command from the first char of the input buffer.
@@ -105,23 +433,34 @@ int main(void) {
 			case 'c':
 				/* fall-through */
 			case 'C':
-				printf("********** Create command issued **********\n");
+				LOG("********** Create command issued **********\n");
 				Create((int)(inputBuffer[2] - '0'));
 				break;
 
+			/* Real-time task */
+			case 'j':
+				/* fall-through */
+			case 'J':
+				LOG("********** Real-time task command issued **********\n");
+				char *rtArgs = inputBuffer + 2;
+				long period = strtol(rtArgs, &rtArgs, 10);
+				long wcet = strtol(rtArgs, &rtArgs, 10);
+				CreateRealTime(period, wcet, strtol(rtArgs, NULL, 10));
+				break;
+
 			/* Exit */
 			case 'e':
 				/* fall-through */
 			case 'E':
-				printf("********** Exit command issued **********\n");
-				Kill(runningProcess->pid);
+				LOG("********** Exit command issued **********\n");
+				Kill(currentCpu->running->pid);
 				break;
 
 			/* Fork */
 			case 'f':
 				/* fall-through */
 			case 'F':
-				printf("********** Fork command issued **********\n");
+				LOG("********** Fork command issued **********\n");
 				Fork();
 				break;
 
@@ -129,7 +468,7 @@ int main(void) {
 			case 'k':
 				/* fall-through */
 			case 'K':
-				printf("********** Kill command issued **********\n");
+				LOG("********** Kill command issued **********\n");
 				pidChars = inputBuffer + 2;
 				pid = atoi(pidChars);
 				Kill(pid);
@@ -139,7 +478,7 @@ int main(void) {
 			case 'q':
 				/* fall-through */
 			case 'Q':
-				printf("********** Quantum command issued **********\n");
+				LOG("********** Quantum command issued **********\n");
 				Quantum();
 				break;
 
@@ -147,58 +486,127 @@ int main(void) {
 			case 'n':
 				/* fall-through */
 			case 'N':
-				printf("********** New semaphore command issued **********\n");
-				int semId = (int)(inputBuffer[2] - '0');
-				char *semValChars = inputBuffer + 4;
-				int semVal = atoi(semValChars);
-				NewSemaphore(semId, semVal);
+				LOG("********** New semaphore command issued **********\n");
+				int semId = atoi(inputBuffer + 2);
+				char *semValChars = strchr(inputBuffer + 2, ' ');
+				int semVal = semValChars ? atoi(semValChars + 1) : 0;
+				char *ceilingChars = semValChars ? strchr(semValChars + 1, ' ') : NULL;
+				NewSemaphore(semId, semVal, ceilingChars ? atoi(ceilingChars + 1) : INIT);
+				break;
+
+			/* Destroy semaphore */
+			case 'd':
+				/* fall-through */
+			case 'D':
+				LOG("********** Destroy semaphore command issued **********\n");
+				DestroySemaphore(atoi(inputBuffer + 2));
 				break;
 
 			/* P semaphore */
 			case 'p':
 				/* fall-through */
 			case 'P':
-				printf("********** Semaphore P command issued **********\n");
-				P((int)(inputBuffer[2] - '0'));
+				LOG("********** Semaphore P command issued **********\n");
+				char *timeoutChars = strchr(inputBuffer + 2, ' ');
+				P(atoi(inputBuffer + 2), timeoutChars ? atol(timeoutChars + 1) : 0);
 				break;
 
 			/* V semaphore */
 			case 'v':
 				/* fall-through */
 			case 'V':
-				printf("********** Semaphore V command issued **********\n");
-				V((int)(inputBuffer[2] - '0'));
+				LOG("********** Semaphore V command issued **********\n");
+				V(atoi(inputBuffer + 2));
 				break;
 
 			/* Send */
 			case 's':
 				/* fall-through */
 			case 'S':
-				printf("********** Send command issued **********\n");
-				Send();
+				LOG("********** Send command issued **********\n");
+				Send(1);
+				break;
+
+			/* Async send */
+			case 'a':
+				/* fall-through */
+			case 'A':
+				LOG("********** Async send command issued **********\n");
+				Send(0);
 				break;
 
 			/* Receive */
 			case 'r':
 				/* fall-through */
 			case 'R':
-				printf("********** Receive command issued **********\n");
-				Receive();
+				LOG("********** Receive command issued **********\n");
+				Receive(1, 1);
+				break;
+
+			/* Try to receive */
+			case 'g':
+				/* fall-through */
+			case 'G':
+				LOG("********** Try receive command issued **********\n");
+				Receive(1, 0);
+				break;
+
+			/* Batch receive */
+			case 'b':
+				/* fall-through */
+			case 'B':
+				LOG("********** Batch receive command issued **********\n");
+				int maxMsgs = atoi(inputBuffer + 2);
+				if (maxMsgs < 1) {
+					LOG_ERROR("Invalid batch size specified (%d). It must be at least 1.\n", maxMsgs);
+					break;
+				}
+				Receive(maxMsgs, 1);
 				break;
 
 			/* Reply */
 			case 'y':
 				/* fall-through */
 			case 'Y':
-				printf("********** Reply command issued **********\n");
+				LOG("********** Reply command issued **********\n");
 				Reply();
 				break;
 
+			/* Run for a number of ticks */
+			case 'w':
+				/* fall-through */
+			case 'W':
+				LOG("********** Run command issued **********\n");
+				RunFor(atol(inputBuffer + 2));
+				break;
+
+			/* Sleep */
+			case 'z':
+				/* fall-through */
+			case 'Z':
+				LOG("********** Sleep command issued **********\n");
+				SleepProcess(atol(inputBuffer + 2));
+				break;
+
+			/* Use CPU */
+			case 'u':
+				/* fall-through */
+			case 'U':
+				LOG("********** Use CPU command issued **********\n");
+				int cpuId = atoi(inputBuffer + 2);
+				if (cpuId < 0 || cpuId >= numCpus) {
+					LOG_ERROR("Invalid CPU specified (%d). It must be between 0 and %d.\n", cpuId, numCpus - 1);
+					break;
+				}
+				currentCpu = &cpus[cpuId];
+				LOG("Commands now act on CPU %d, running PID %d.\n", cpuId, currentCpu->running->pid);
+				break;
+
 			/* Procinfo */
 			case 'i':
 				/* fall-through */
 			case 'I':
-				printf("********** Process info command issued **********\n");
+				LOG("********** Process info command issued **********\n");
 				pidChars = inputBuffer + 2;
 				pid = atoi(pidChars);
 				ProcInfo(pid);
@@ -208,18 +616,35 @@ int main(void) {
 			case 't':
 				/* fall-through */
 			case 'T':
-				printf("********** Process info command issued **********\n");
+				LOG("********** Process info command issued **********\n");
 				TotalInfo();
 				break;
 
+			/* Latency histograms */
+			case 'h':
+				/* fall-through */
+			case 'H':
+				LOG("********** Latency command issued **********\n");
+				PrintLatencies(stdout);
+				break;
+
+			/* Dump the event trace */
+			case 'x':
+				/* fall-through */
+			case 'X':
+				LOG("********** Trace dump command issued **********\n");
+				DumpTrace();
+				break;
+
 			/* Invalid command */
 			default:
-				printf("********** Invalid command issued **********\n");
-				printf("Please try again.\n");
+				LOG_ERROR("********** Invalid command issued **********\n");
+				LOG_ERROR("Please try again.\n");
 				break;
 		} /* End of command switch statement */
 
-		printf("********** Ready for next command **********\n\n");
+		StepWorkload();
+		LOG("********** Ready for next command **********\n\n");
 	}
 }
 
@@ -235,49 +660,116 @@ static int Create(int priority) {
 	if ((priority == INIT && initProcess != NULL) || 
 			(priority > INIT) || 
 			(priority < HIGH)) {
-		printf("ERROR - Invalid priority specified. Failed to create process.\n\n");
+		LOG_ERROR("ERROR - Invalid priority specified. Failed to create process.\n\n");
 		free(process);
 		return -1;
 	} else {
 		process->priority = priority;
 	}
 
-	process->pid = nextAvailPid;
-	nextAvailPid++;
 	process->state = READY;
-	process->msg = NULL;
+	if (RegisterProcess(process) < 0) {
+		LOG_ERROR("ERROR - Out of memory for the PID table. Failed to create process.\n\n");
+		free(process);
+		return -1;
+	}
 
+	EMIT_EVENT(EVENT_CREATE, process->pid, process->priority);
 	AddProcessToReadyQueue(process);
 
-	printf("Process created successfully.\n");
-	printf("PID: %d\n", process->pid);
-	printf("Added to %s priority (%d) ready queue.\n", 
+	LOG("Process created successfully.\n");
+	LOG("PID: %d\n", process->pid);
+	LOG("Added to %s priority (%d) ready queue.\n", 
 		PRIORITIES[process->priority], process->priority);
 	return process->pid;
 }
 
+/**
+ * Creates a periodic real-time task and releases its first job now. A deadline of 0 means the period.
+ * The task stays on the CPU with the least real-time utilization, and whether that CPU can meet
+ * every deadline under the real-time policy is reported.
+ * Returns the PID on success, -1 on failure.
+ */
+static int CreateRealTime(long period, long wcet, long deadline) {
+	if (period < 1 || wcet < 1) {
+		LOG_ERROR("Invalid real-time task. The period and WCET must be at least 1 tick.\n");
+		return -1;
+	}
+	deadline = deadline == 0 ? period : deadline;
+	if (deadline < wcet || deadline > period) {
+		LOG_ERROR("Invalid deadline (%ld). It must be between the WCET (%ld) and the period (%ld).\n", 
+			deadline, wcet, period);
+		return -1;
+	}
+
+	CPU *cpu = LeastRtUtilizedCpu();
+	PROCESS *process = (PROCESS *)malloc(sizeof(PROCESS));
+	process->priority = HIGH;
+	process->state = READY;
+	if (RunQueueReserve(&cpu->rtQueue, numRtTasks + 1) < 0 || RegisterProcess(process) < 0) {
+		LOG_ERROR("ERROR - Out of memory for the PID table. Failed to create real-time task.\n\n");
+		free(process);
+		return -1;
+	}
+	process->sched.cpu = cpu->id;
+	process->rt.period = (unsigned long)period;
+	process->rt.wcet = (unsigned long)wcet;
+	process->rt.deadline = (unsigned long)deadline;
+	numRtTasks++;
+	EMIT_EVENT(EVENT_CREATE, process->pid, process->priority);
+
+	LOG("Real-time task created successfully.\n");
+	LOG("PID: %d, period: %ld, WCET: %ld, deadline: %ld, on CPU %d\n", process->pid, period, wcet, deadline, 
+		cpu->id);
+	double density;
+	double hyperbolic;
+	int implicit;
+	double utilization = RtUtilization(cpu->id, &density, &hyperbolic, &implicit);
+	LOG("Real-time utilization of CPU %d: %.3f, density: %.3f\n", cpu->id, utilization, density);
+	if (utilization > 1.0) {
+		LOG("The CPU is overloaded. Deadlines will be missed.\n");
+	} else if (strcmp(rtPolicy->name, "edf") == 0) {
+		LOG(density <= 1.0 ? "EDF meets every deadline, as the density is at most 1.\n" : 
+			"EDF may miss deadlines, as the density is over 1.\n");
+	} else {
+		LOG(implicit && hyperbolic <= 2.0 ? "RM meets every deadline, by the hyperbolic bound.\n" : 
+			"RM isn't guaranteed to meet every deadline. Run it to find out.\n");
+	}
+
+	process->rt.releasedAt = clockTick;
+	process->rt.jobsReleased = 1;
+	EMIT_EVENT(EVENT_RELEASE, process->pid, 1);
+	TimerAdd(&timerWheel, &process->rt.timer, clockTick + process->rt.period);
+	StartJob(process);
+	return process->pid;
+}
+
 /** 
  * Forks the currently running process.
  * Will fail on an attempt to fork the INIT process.
  * Returns PID of forked process on success, -1 on failure.
  */
 static int Fork() {
-	if (runningProcess == initProcess) {
-		printf("Attempted to fork the init process. Fork failed.\n");
+	if (currentCpu->running->priority == INIT) {
+		LOG_ERROR("Attempted to fork the init process. Fork failed.\n");
 		return -1;
 	}
 
 	PROCESS *process = (PROCESS *)malloc(sizeof(PROCESS));
-	process->pid = nextAvailPid;
-	nextAvailPid++;
 	process->state = READY;
-	process->priority = runningProcess->priority;
+	process->priority = currentCpu->running->basePriority;
+	if (RegisterProcess(process) < 0) {
+		LOG_ERROR("Out of memory for the PID table. Fork failed.\n");
+		free(process);
+		return -1;
+	}
 
+	EMIT_EVENT(EVENT_FORK, process->pid, currentCpu->running->pid);
 	AddProcessToReadyQueue(process);
 
-	printf("Process forked successfully.\n");
-	printf("PID of forked process: %d\n", process->pid);
-	printf("Added to %s priority ready queue.\n", PRIORITIES[process->priority]);
+	LOG("Process forked successfully.\n");
+	LOG("PID of forked process: %d\n", process->pid);
+	LOG("Added to %s priority ready queue.\n", PRIORITIES[process->priority]);
 	return process->pid;
 }
 
@@ -290,33 +782,33 @@ static int Kill(int pid) {
 	/* Terminate OS if only INIT process is left and it is killed */
 	/* Otherwise keep the INIT process alive and return -1 */
 	if (pid == 0) { 
-		if (ListCount(highReadyQueue) == 0
-				&& ListCount(normalReadyQueue) == 0
-				&& ListCount(lowReadyQueue) == 0
-				&& ListCount(blockedQueue) == 0) {
-			printf("Killing the INIT process.\n");
-			printf("No processes running.\n");
-			printf("Terminating the OS. Goodbye.\n\n");
+		if (TotalReadyProcesses() == 0 && NumBlockedProcesses() == 0) {
+			LOG("Killing the INIT process.\n");
+			LOG("No processes running.\n");
+			LOG("Terminating the OS. Goodbye.\n\n");
 			exit(0);
 		} else {
-			printf("Can't kill the INIT process while other processes are in the OS.\n");
+			LOG_ERROR("Can't kill the INIT process while other processes are in the OS.\n");
 			return -1;
 		}
 	}
 
 	/* Check if PID within the range of created PIDs */
 	if (pid < 0 || pid >= nextAvailPid) {
-		printf("Invalid PID specified.\n");
+		LOG_ERROR("Invalid PID specified.\n");
 		return -1;
 	}
 
-	/* Check if PID is the running process */
-	if (pid == runningProcess->pid) {
-		printf("The killed process was the currently running process.\n");
-		printf("The OS will select the next process to run.\n");
+	/* Check if PID is running, on this or another CPU */
+	PROCESS *killedProcess = GetProcByPid(pid);
+	if (killedProcess != NULL && killedProcess->state == RUNNING) {
+		LOG("The killed process was the currently running process.\n");
+		LOG("The OS will select the next process to run.\n");
 
 		/* Check queues in priority order to see which should run */
-		SelectNewRunningProcess();
+		EMIT_EVENT(EVENT_KILL, pid, killedProcess->priority);
+		SelectNewRunningProcess(&cpus[killedProcess->sched.cpu]);
+		DestroyProcess(killedProcess);
 		return pid;
 	}
 
@@ -329,340 +821,958 @@ static int Kill(int pid) {
 }
 
 /** 
- * Pre-empts the running process and puts it back on the appropriate ready queue.
- * Starts running the highest priority process on a ready queue.
- * Returns the PID of the new running process, or -1 on failure.
+ * Advances the clock by one tick and expires the quantum there, however long it had left.
+ * Returns the PID of the new running process on the current CPU.
  */
 static int Quantum() {
-	/* Pre-empt the running process and add it back to the appropriate queue */
-	printf("Time quantum expired.\n");
-	if (runningProcess != NULL && runningProcess->priority != INIT) {
-		printf("Adding process PID %d back to %s priority ready queue.\n", 
-			runningProcess->pid, PRIORITIES[runningProcess->priority]);
-		AddProcessToReadyQueue(runningProcess);
-	} else {
-		printf("The running process was the INIT process. Not adding to ready queue...\n");
-		initProcess->state = READY;
-	}
-
-	SelectNewRunningProcess();
-	return runningProcess->pid;
+	TimerCancel(&timerWheel, &quantumTimer);
+	AdvanceClock(clockTick + 1);
+	ExpireQuantum();
+	return currentCpu->running->pid;
 }
 
-/**
- * Creates a new semaphore with the supplied ID and value, 
- * if the semaphore with that ID hasn't been initialized.
- * Returns the semaphore ID on success, 0 on failure.
+/** 
+ * Pre-empts the running process of every CPU and puts it back on the appropriate ready queue.
+ * Then each CPU starts running the next process its policy picks, stealing one if it has none.
+ * The next quantum expires quantumTicks from now.
  */
-static int NewSemaphore(int id, int value) {
-	/* Check if semaphore ID is valid */
-	if (id < 0 || id > 4) {
-		printf("Invalid semaphore ID specified. ID must be a value between 0 and 4.\n");
-		printf("Failed to initialize semaphore.\n");
-		return 0;
-	}
+static void ExpireQuantum() {
+	LOG("Time quantum expired (clock tick %lu).\n", clockTick);
+	quantaInline++;
 
-	/* Check if semaphore has already been initialized */
-	if (semaphoreArr[id] != NULL) {
-		printf("The semaphore with ID %d has already been initialized.\n", id);
-		printf("Failed to initialize semaphore.\n");
-		return 0;
+	/* Pre-empt the running processes and add them back to the appropriate queues */
+	for (int i = 0; i < numCpus; i++) {
+		PreemptCpu(&cpus[i]);
 	}
 
-	/* Initialize the semaphore struct */
-	SEMAPHORE *semaphore = (SEMAPHORE *)malloc(sizeof(SEMAPHORE));
-
-	/* Check if semaphore value is appropriate and assign it */
-	if (value >= 0) {
-		semaphore->value = value;
-	} else {
-		printf("The semaphore value %d is invalid. It must be 0 or greater.\n", value);
-		printf("Failed to initialize semaphore.\n");
-		free(semaphore);
-		return 0;
+	/* Each CPU runs the next process on its own runqueue. Once all have, the ones left empty steal. */
+	for (int i = 0; i < numCpus; i++) {
+		PickLocalProcess(&cpus[i]);
 	}
+	for (int i = 0; i < numCpus; i++) {
+		if (cpus[i].running->state != RUNNING) {
+			if (numCpus > 1) {
+				LOG("CPU %d:\n", cpus[i].id);
+			}
+			SelectNewRunningProcess(&cpus[i]);
+		}
+	}
+	TimerAdd(&timerWheel, &quantumTimer, clockTick + quantumTicks);
+}
 
-	/* Initialize list of processes blocked on this semaphore */
-	semaphore->blockedList = ListCreate();
-	if (semaphore->blockedList == NULL) {
-		printf("Failed to initialize the semaphore's blocked process list.\n");
-		printf("Failed to initialize semaphore.\n");
-		free(semaphore);
-		return 0;
+/**
+ * Runs the simulation for the given number of ticks. Quanta expire every quantumTicks ticks, and
+ * sleeps, timeouts and message deliveries happen at their ticks. Ticks in between cost nothing.
+ */
+static void RunFor(long ticks) {
+	if (ticks < 1) {
+		LOG_ERROR("Invalid number of ticks specified (%ld). It must be at least 1.\n", ticks);
+		return;
 	}
 
-	semaphoreArr[id] = semaphore;
-	printf("Semaphore with ID %d and value %d created.\n", id, semaphore->value);
-	return id;
+	LOG("Running until clock tick %lu.\n", clockTick + ticks);
+	AdvanceClock(clockTick + ticks);
+	LOG("Reached clock tick %lu. The running process has PID %d.\n", clockTick, currentCpu->running->pid);
 }
 
-/* Implements the semaphore P function */
-static void P(int id) {
-	/* Check if semaphore ID is valid */
-	if (id < 0 || id >= NUM_SEMAPHORES) {
-		printf("The semaphore ID %d is invalid. ID must be between 0-4.\n", id);
-		printf("Failed to P on semaphore %d.\n", id);
-		return;
+/**
+ * Moves the clock forward to until, handling every timer that expires on the way.
+ * In threaded mode, long runs of quanta with nothing else due are handed to the CPU threads,
+ * and the rest is stepped through one event at a time on the command thread.
+ */
+static void AdvanceClock(unsigned long until) {
+	while (cpuThreads != NULL && clockTick < until) {
+		if (RunQuantaOnCpuThreads(until)) {
+			continue;
+		}
+		unsigned long next = TimerNextTick(&timerWheel);
+		if (next > until) {
+			break;
+		}
+		TimerAdvance(&timerWheel, next);
+		clockTick = next;
 	}
+	TimerAdvance(&timerWheel, until);
+	clockTick = until;
+}
 
-	/* Check if semaphore is initialized */
-	if (semaphoreArr[id] == NULL) {
-		printf("The semaphore with ID %d has not been initialized yet.\n", id);
-		printf("Failed to P on semaphore %d.\n", id);
+/**
+ * Puts the running process to sleep for the given number of ticks and runs the next process.
+ * The INIT process can't sleep.
+ */
+static void SleepProcess(long ticks) {
+	PROCESS *sleeper = currentCpu->running;
+	if (ticks < 1) {
+		LOG_ERROR("Invalid number of ticks specified (%ld). It must be at least 1.\n", ticks);
 		return;
 	}
-
-	/* Check if there is a process running. Fail if there isn't. */
-	if (runningProcess == NULL) {
-		printf("There is no process currently running (all processes must be blocked).\n");
-		printf("Failed to P on semaphore %d.\n", id);
+	if (sleeper->priority == INIT) {
+		LOG_ERROR("The INIT process is not allowed to sleep.\n");
+		return;
+	}
+	if (IS_REAL_TIME(sleeper)) {
+		LOG_ERROR("A real-time task can't sleep. It waits for its next release once its job is done.\n");
 		return;
 	}
 
-	SEMAPHORE *semaphore = semaphoreArr[id];
-	semaphore->value--;
-	printf("The semaphore value is now %d.\n", semaphore->value);
-	
-	/* Block the running process if the sem value is < 0 */
-	if (semaphore->value < 0) {
-		/* Blocking the INIT process is not allowed. Fail to P */
-		if (runningProcess == initProcess) {
-			printf("The INIT process is not allowed to be blocked.\n");
-			printf("Reverting the semaphore value to %d.\n", ++semaphore->value);
-			printf("Failed to P on semaphore %d.\n", id);
-			return;
-		}
+	LOG("PID %d will sleep until clock tick %lu.\n", sleeper->pid, clockTick + ticks);
+	SetProcessState(sleeper, SLEEPING);
+	EMIT_EVENT(EVENT_SLEEP, sleeper->pid, (int)ticks);
+	sleeper->timer.fire = SleepTimerFired;
+	TimerAdd(&timerWheel, &sleeper->timer, clockTick + ticks);
+	numSleeping++;
 
-		printf("Blocking the running process (PID %d).\n", runningProcess->pid);
-		runningProcess->state = BLOCKED_SEM;
-		ListAppend(blockedQueue, runningProcess);
+	LOG("Selecting a new process to run...\n");
+	SelectNewRunningProcess(currentCpu);
+}
 
-		/* Add the process to the list of processes blocked on this sem */
-		ListAppend(semaphore->blockedList, runningProcess);
+/* Ends the current quantum when its timer expires during a run */
+static void QuantumTimerFired(TIMER *timer) {
+	clockTick = timer->expires;
+	ExpireQuantum();
+	StepWorkload();
+}
 
-		/* Select a new process to run */
-		printf("Selecting a new process to run...\n");
-		SelectNewRunningProcess();
-	} else {
-		printf("The semaphore value is still greater or equal to 0.\n");
-		printf("The running process (PID %d) will not be blocked.\n", runningProcess->pid);
-	}
+/* Wakes a sleeping process and puts it back on a ready queue */
+static void SleepTimerFired(TIMER *timer) {
+	PROCESS *sleeper = LINK_ITEM(timer, PROCESS, timer);
+	clockTick = timer->expires;
+	LOG("PID %d woke up at clock tick %lu and was placed on the ready queue.\n", sleeper->pid, clockTick);
+	numSleeping--;
+	EMIT_EVENT(EVENT_WAKE, sleeper->pid, -1);
+	AddProcessToReadyQueue(sleeper);
+	StepWorkload();
 }
 
-/* Implements the semaphore V function */
-static void V(int id) {
-	/* Check if semaphore ID is valid */
-	if (id < 0 || id >= NUM_SEMAPHORES) {
-		printf("The semaphore ID %d is invalid. ID must be between 0-4.\n", id);
-		printf("Failed to V on semaphore %d.\n", id);
-		return;
+/**
+ * Takes a process that waited too long off its semaphore, undoing its P, 
+ * and puts it back on a ready queue.
+ */
+static void SemTimeoutFired(TIMER *timer) {
+	PROCESS *waiter = LINK_ITEM(timer, PROCESS, timer);
+	SEMAPHORE *semaphore = waiter->blockedSem;
+	clockTick = timer->expires;
+	LOG("PID %d gave up waiting on semaphore %d at clock tick %lu.\n", waiter->pid, semaphore->id, 
+		clockTick);
+	semaphore->value++;
+	LOG("The semaphore value is now %d.\n", semaphore->value);
+	UnblockFromSemaphore(waiter);
+	EMIT_EVENT(EVENT_TIMEOUT, waiter->pid, semaphore->id);
+	AddProcessToReadyQueue(waiter);
+	StepWorkload();
+}
+
+/**
+ * Loads a workload file and creates the semaphores it declares. Its processes are created as
+ * the clock reaches their arrival ticks, starting with those that arrive at the current tick.
+ * Returns 0 on success, -1 if the file is invalid or a semaphore can't be created.
+ */
+static int LoadWorkload(const char *path) {
+	if (WorkloadLoad(&workload, path) < 0) {
+		return -1;
 	}
+	workloadPids = (int *)malloc(sizeof(int) * ((size_t)workload.numProcs + 1));
+	if (workloadPids == NULL) {
+		fprintf(stderr, "Out of memory for the workload.\n");
+		return -1;
+	}
+	memset(workloadPids, -1, sizeof(int) * workload.numProcs);
 
-	/* Check if semaphore is initialized */
-	if (semaphoreArr[id] == NULL) {
-		printf("The semaphore with ID %d has not been initialized yet.\n", id);
-		printf("Failed to V on semaphore %d.\n", id);
-		return;
+	for (uint32_t i = 0; i < workload.numSems; i++) {
+		if (NewSemaphore(workload.sems[i].id, workload.sems[i].value, INIT) < 0) {
+			fprintf(stderr, "%s: failed to create semaphore %d.\n", path, workload.sems[i].id);
+			return -1;
+		}
 	}
+	LOG("Loaded %u processes and %u semaphores from workload %s.\n", workload.numProcs, workload.numSems, 
+		path);
 
-	SEMAPHORE *semaphore = semaphoreArr[id];
-	semaphore->value++;
-	printf("The semaphore value is now %d.\n", semaphore->value);
+	TimerInit(&arrivalTimer, ArrivalTimerFired);
+	AdmitArrivals();
+	StepWorkload();
+	return 0;
+}
 
-	/* Wake up a blocked process if the sem value is <= 0 */
-	if (semaphore->value <= 0) {
-		printf("Waking up a process blocked on this semaphore.\n");
-		PROCESS *procToWake = ListFirst(semaphore->blockedList);
-		ListRemove(semaphore->blockedList);
-		printf("This process has PID %d and priority %s.\n", 
-			procToWake->pid, PRIORITIES[procToWake->priority]);
-		RemovePidFromBlockedQueue(procToWake);
-		AddProcessToReadyQueue(procToWake);
-	} else {
-		printf("The semaphore value is greater than 0.\n");
-		printf("There are no blocked processes to wake up.\n");
+/* Creates every workload process that has arrived by now, and sets the timer for the next arrival */
+static void AdmitArrivals() {
+	while (nextArrival < workload.numProcs && workload.procs[nextArrival].arrival <= clockTick) {
+		const WL_PROC *arrival = &workload.procs[nextArrival];
+		int pid = Create((int)arrival->priority);
+		if (pid >= 0) {
+			PROCESS *process = pidTable[pid];
+			process->nextOp = &workload.ops[arrival->firstOp];
+			process->endOp = process->nextOp + arrival->numOps;
+			StartStep(process);
+			workloadLive++;
+		}
+		workloadPids[nextArrival++] = pid;
+	}
+	if (nextArrival < workload.numProcs) {
+		TimerAdd(&timerWheel, &arrivalTimer, workload.procs[nextArrival].arrival);
 	}
 }
 
-/** 
- * Send a message to the PID specified.
- * Both the message and PID are extracted from the user input buffer.
+/**
+ * Runs the workload steps, and finishes the real-time jobs, due on every CPU. A step on one CPU
+ * can wake a process that another, idle CPU then picks up, so the CPUs are gone over again until
+ * nothing is due on any of them.
  */
-static void Send() {
-	/**
-	 * Find the PID. Separate the PID and message by finding the space in between them 
-	 * and null-terminating the end of the PID. 
-	 */
-	char *space = strchr(inputBuffer + 2, ' ');
-	char *inputMsg = space + 1;
-	*space = '\0';
-
-	/* Parse out the PID and validate it. */
-	int pid = atoi(inputBuffer + 2);
-	if (pid < 0 || pid >= nextAvailPid) {
-		printf("Invalid PID specified (%d).\n", pid);
-		printf("Failed to send the message.\n");
+static void StepWorkload() {
+	if (workloadPids == NULL && numRtTasks == 0) {
 		return;
 	}
+	int stepped;
+	do {
+		stepped = 0;
+		for (int i = 0; i < numCpus; i++) {
+			stepped |= RunProcessSteps(&cpus[i]);
+		}
+	} while (stepped);
+}
 
-	/* Check if the message is a valid length. */
-	if (strlen(inputMsg) > MAX_MSG_LEN) {
-		printf("The message is too long. The max length is 40 characters.\n");
-		printf("Failed to send the message.\n");
-		return;
-	} else if (!strlen(inputMsg)) {
-		printf("Empty messages can't be sent.\n");
-		printf("Failed to send the message.\n");
-		return;
-	}
+/**
+ * Takes the CPU's running process through its workload steps until it is in the middle of
+ * a CPU burst, or gives up the CPU, in which case the next process is taken through its steps.
+ * An idle CPU runs a ready process straight away rather than at the next quantum.
+ * Sets the CPU's burst timer for the end of the burst the CPU is left running, if any.
+ * Returns 1 if any step was taken or process run, 0 otherwise.
+ */
+static int RunProcessSteps(CPU *cpu) {
+	/* Steps act on the CPU's running process the way commands do after the use CPU command */
+	CPU *commandCpu = currentCpu;
+	currentCpu = cpu;
+	int stepped = 0;
+	while (1) {
+		PROCESS *process = cpu->running;
+		if (process == cpu->idle) {
+			if (RunnableProcesses(cpu) == 0) {
+				break;
+			}
+			SetProcessState(process, READY);
+			SelectNewRunningProcess(cpu);
+			stepped = 1;
+			continue;
+		}
+		if (IS_REAL_TIME(process)) {
+			ChargeBurst(process);
+			if (process->burstLeft > 0) {
+				TimerAdd(&timerWheel, &cpu->burstTimer, clockTick + process->burstLeft);
+				currentCpu = commandCpu;
+				return stepped;
+			}
+			FinishJob(process);
+			stepped = 1;
+			continue;
+		}
+		if (process->nextOp == NULL) {
+			break;
+		}
+		if (process->nextOp == process->endOp) {
+			LOG("PID %d has finished its workload and exits.\n", process->pid);
+			Kill(process->pid);
+			stepped = 1;
+			continue;
+		}
 
-	/* Build the message struct to send. */
-	printf("Building the message to send to PID %d.\n", pid);
-	MSG *msg = (MSG *)malloc(sizeof(MSG));
-	char *msgContent = (char *)malloc(sizeof(char) * (strlen(inputMsg) + 1));
-	strcpy(msgContent, inputMsg);
-	msg->rcvPid = pid;
-	msg->sendPid = runningProcess->pid;
-	msg->text = msgContent;
-	msg->type = NEW;
-
-	/* Check if the process that the message will be sent to is already blocked on a receive. */
-	/* Search the blocked queue for the destination PID. */
-	PROCESS *rcvProcess = SearchBlockedQueue(pid);
-	if (rcvProcess && rcvProcess->state == BLOCKED_RCV) {
-		printf("The destination process was already waiting for a message.\n");
-		
-		/* Copy the message to the process */
-		rcvProcess->msg = msg;
-
-		/* Wake up the process */
-		printf("Waking up the receiver process and placing it on the ready queue.\n");
-		rcvProcess->state = READY;
-		RemovePidFromBlockedQueue(rcvProcess);
-		AddProcessToReadyQueue(rcvProcess);
-	} else {
-		/* Add the message to the inbox. The receiver is not waiting for a message. */
-		ListAppend(msgQueue, msg);
+		const WL_OP *op = process->nextOp;
+		if (op->type == WL_CPU) {
+			ChargeBurst(process);
+			if (process->burstLeft > 0) {
+				TimerAdd(&timerWheel, &cpu->burstTimer, clockTick + process->burstLeft);
+				currentCpu = commandCpu;
+				return stepped;
+			}
+			process->nextOp++;
+			StartStep(process);
+			stepped = 1;
+			continue;
+		}
+
+		/* The other steps take no time. Move past the step first, as it may block the process. */
+		process->nextOp++;
+		StartStep(process);
+		stepped = 1;
+		LOG("PID %d takes its workload step: %s.\n", process->pid, WL_OP_NAMES[op->type]);
+		switch (op->type) {
+			case WL_IO:
+				SleepProcess((long)op->arg);
+				break;
+			case WL_SEND:
+				SendMsg(workloadPids[op->arg], WORKLOAD_MSG, 1);
+				break;
+			case WL_RECV:
+				Receive(1, 1);
+				break;
+			case WL_REPLY:
+				ReplyMsg(process->lastSenderPid, WORKLOAD_REPLY);
+				break;
+			case WL_P:
+				P((int)op->arg, 0);
+				break;
+			case WL_V:
+				V((int)op->arg);
+				break;
+			default:
+				break;
+		}
 	}
 
-	/* Block the sending process until a reply is received. */
-	if (runningProcess != initProcess) {
-		printf("Blocking the sending process (PID %d) until a reply is received.\n", runningProcess->pid);
-		runningProcess->state = BLOCKED_SEND;
-		ListAppend(blockedQueue, runningProcess);
+	TimerCancel(&timerWheel, &cpu->burstTimer);
+	currentCpu = commandCpu;
+	return stepped;
+}
 
-		/* Allow the next ready process to run. */
-		printf("Selecting a new ready process to run.\n");
-		SelectNewRunningProcess();
-	} else {
-		/* Don't allow the INIT process to block. */
-		printf("The sender is the INIT process. Cannot block the INIT process.\n");
+/* Sets up the step at nextOp. A CPU burst starts with all of its ticks left to run. */
+static void StartStep(PROCESS *process) {
+	process->burstLeft = 0;
+	if (process->nextOp < process->endOp && process->nextOp->type == WL_CPU) {
+		process->burstLeft = process->nextOp->arg;
 	}
+	process->burstSince = clockTick;
 }
 
-/** 
- * Receive a message from any process.
- * The running process will immediately receive and print a message if one is already queued 
- * for it in the inbox.
- * Will block the process if there is no message to receive for this process in the inbox.
- */
-static void Receive() {
-	/* Check if the inbox contains messages queued for the receiving process. */
-	MSG *msgToFind = (MSG *)malloc(sizeof(MSG));
-	msgToFind->rcvPid = runningProcess->pid;
-	MSG *foundMsg = NULL;
-	ListFirst(msgQueue);
-	foundMsg = ListSearch(msgQueue, MsgComparator, msgToFind);
-	if (foundMsg) {
-		printf("There was a message already waiting in the queue for the running process (PID %d).\n", 
-			runningProcess->pid);
-		printf("Message received from PID %d.\n", foundMsg->sendPid);
-		printf("Message body: %s\n", foundMsg->text);
-
-		/* Remove the message from the queue and free memory used */
-		ListRemove(msgQueue);
-		free(foundMsg->text);
-		free(foundMsg);
-		free(msgToFind);
-		return;
-	} else { 
-		/* No message for the running process already in the inbox. */
-		printf("No message in the inbox for the running process (PID %d).\n", 
-			runningProcess->pid);
+/* Takes the ticks the process has run since burstSince off its CPU burst */
+static void ChargeBurst(PROCESS *process) {
+	unsigned long ran = clockTick - process->burstSince;
+	process->burstLeft -= ran < process->burstLeft ? ran : process->burstLeft;
+	process->burstSince = clockTick;
+}
 
-		/* Block the process until a message is received for it. */
-		if (runningProcess != initProcess) {
-			printf("Blocking the running process (PID %d) until a message is received.\n", 
-				runningProcess->pid);
-			runningProcess->state = BLOCKED_RCV;
-			ListAppend(blockedQueue, runningProcess);
-
-			/* Allow the next ready process to run. */
-			printf("Selecting a new ready process to run.\n");
-			SelectNewRunningProcess();
-		} else {
-			/* INIT process not allowed to be blocked. */
-			printf("The receiver is the INIT process. Cannot block the INIT process.\n");
+/**
+ * Used when the input runs out. Advances the clock until every workload process has arrived
+ * and exited, or until the ones left all wait on each other with nothing pending to wake them.
+ */
+static void RunWorkloadToEnd() {
+	if (workloadPids == NULL) {
+		return;
+	}
+
+	LOG("Running the workload until every process has exited.\n");
+	while (workloadLive > 0 || nextArrival < workload.numProcs) {
+		/* Real-time tasks always have their next release pending, which doesn't help */
+		if (nextArrival == workload.numProcs && workloadWaiting == workloadLive && 
+				timerWheel.count == TimerPending(&quantumTimer) + numRtTasks) {
+			LOG_ERROR("The workload is stuck at clock tick %lu. Its %d live processes all wait on each other.\n",
+				clockTick, workloadLive);
+			return;
 		}
+		AdvanceClock(TimerNextTick(&timerWheel));
 	}
+	LOG("The workload finished at clock tick %lu.\n", clockTick);
+}
 
+/* Creates the workload processes arriving now */
+static void ArrivalTimerFired(TIMER *timer) {
+	clockTick = timer->expires;
+	AdmitArrivals();
+	StepWorkload();
 }
 
-/** 
- * Reply to a process that sent a message.
- * Will fail if a process attempts to reply to a process that isn't blocked
- * on a send.
- */
-static void Reply() {
+/* Moves a running workload process on to its next step once its CPU burst is over */
+static void BurstTimerFired(TIMER *timer) {
+	clockTick = timer->expires;
+	StepWorkload();
+}
+
+/* Releases the next job of a real-time task. It starts now unless an earlier job is unfinished. */
+static void ReleaseTimerFired(TIMER *timer) {
+	PROCESS *task = LINK_ITEM(timer, PROCESS, rt.timer);
+	clockTick = timer->expires;
+	task->rt.jobsReleased++;
+	EMIT_EVENT(EVENT_RELEASE, task->pid, (int)task->rt.jobsReleased);
+	TimerAdd(&timerWheel, timer, clockTick + task->rt.period);
+	if (task->rt.jobsReleased - task->rt.jobsDone == 1) {
+		LOG("PID %d released real-time job %lu at clock tick %lu.\n", task->pid, task->rt.jobsReleased, 
+			clockTick);
+		task->rt.releasedAt = clockTick;
+		numSleeping--;
+		StartJob(task);
+	} else {
+		LOG("PID %d released real-time job %lu at clock tick %lu, behind %lu unfinished.\n", task->pid, 
+			task->rt.jobsReleased, clockTick, task->rt.jobsReleased - task->rt.jobsDone - 1);
+	}
+	StepWorkload();
+}
+
+/* Makes the job released at rt.releasedAt ready to run, pre-empting its CPU if it should run first */
+static void StartJob(PROCESS *task) {
+	task->burstLeft = task->rt.wcet;
+	task->burstSince = clockTick;
+	AddProcessToReadyQueue(task);
+	PreemptForJob(task);
+}
+
+/**
+ * Records the finish of a real-time task's running job. The next job starts straight away if it
+ * was released meanwhile; otherwise the task sleeps until the next release. The CPU runs what's next.
+ */
+static void FinishJob(PROCESS *task) {
+	RT_TASK *rt = &task->rt;
+	unsigned long response = clockTick - rt->releasedAt;
+	rt->jobsDone++;
+	rtJobsDone++;
+	HistRecord(&cpus[task->sched.cpu].rtResponse, response);
+	if (response > rt->worstResponse) {
+		rt->worstResponse = response;
+	}
+	if (response > rt->deadline) {
+		rt->misses++;
+		rtMisses++;
+		LOG("PID %d finished real-time job %lu %lu ticks after its deadline.\n", task->pid, rt->jobsDone, 
+			response - rt->deadline);
+		EMIT_EVENT(EVENT_DEADLINE_MISS, task->pid, (int)(response - rt->deadline));
+	} else {
+		LOG("PID %d finished real-time job %lu in %lu ticks.\n", task->pid, rt->jobsDone, response);
+	}
+
+	if (rt->jobsReleased > rt->jobsDone) {
+		rt->releasedAt += rt->period;
+		task->burstLeft = rt->wcet;
+		AddProcessToReadyQueue(task);
+	} else {
+		SetProcessState(task, SLEEPING);
+		numSleeping++;
+		EMIT_EVENT(EVENT_SLEEP, task->pid, (int)(rt->timer.expires - clockTick));
+	}
+	SelectNewRunningProcess(&cpus[task->sched.cpu]);
+}
+
+/**
+ * Pre-empts the CPU of a task whose job just became ready, unless the CPU is running a real-time
+ * task that comes first. The pre-empted process isn't charged a quantum, so MLFQ doesn't demote it
+ * and stride and CFS don't advance its key, but under rr and mlfq it joins the back of its level
+ * like any process that becomes ready.
+ */
+static void PreemptForJob(PROCESS *task) {
+	CPU *cpu = &cpus[task->sched.cpu];
+	PROCESS *running = cpu->running;
+	if (IS_REAL_TIME(running) && running->sched.key <= task->sched.key) {
+		return;
+	}
+
+	if (running == cpu->idle) {
+		SetProcessState(running, READY);
+	} else {
+		LOG("The real-time task PID %d pre-empts PID %d.\n", task->pid, running->pid);
+		AddProcessToReadyQueue(running);
+	}
+	SelectNewRunningProcess(cpu);
+}
+
+/* Returns the CPU whose real-time tasks use the least of it, where a new task is placed */
+static CPU *LeastRtUtilizedCpu() {
+	CPU *best = &cpus[0];
+	double bestUtilization = 0.0;
+	for (int i = 0; i < numCpus; i++) {
+		double density;
+		double hyperbolic;
+		int implicit;
+		double utilization = RtUtilization(i, &density, &hyperbolic, &implicit);
+		if (i == 0 || utilization < bestUtilization) {
+			best = &cpus[i];
+			bestUtilization = utilization;
+		}
+	}
+	return best;
+}
+
+/**
+ * Returns the sum of wcet / period over the real-time tasks on a CPU. Also sets the sum of
+ * wcet / deadline, the product of (wcet / period + 1) for the hyperbolic bound on RM, and
+ * whether every deadline equals its period, which that bound needs.
+ */
+static double RtUtilization(int cpuId, double *density, double *hyperbolic, int *implicit) {
+	double utilization = 0.0;
+	*density = 0.0;
+	*hyperbolic = 1.0;
+	*implicit = 1;
+	for (int pid = 0; pid < nextAvailPid && numRtTasks > 0; pid++) {
+		PROCESS *process = pidTable[pid];
+		if (process == NULL || !IS_REAL_TIME(process) || process->sched.cpu != cpuId) {
+			continue;
+		}
+		double share = (double)process->rt.wcet / (double)process->rt.period;
+		utilization += share;
+		*density += (double)process->rt.wcet / (double)process->rt.deadline;
+		*hyperbolic *= share + 1.0;
+		*implicit &= process->rt.deadline == process->rt.period;
+	}
+	return utilization;
+}
+
+/* Returns how many of a real-time task's unfinished jobs are already past their deadline */
+static unsigned long LateJobs(PROCESS *task) {
+	RT_TASK *rt = &task->rt;
+	unsigned long unfinished = rt->jobsReleased - rt->jobsDone;
+	if (unfinished == 0 || clockTick <= rt->releasedAt + rt->deadline) {
+		return 0;
+	}
+	/* Jobs are released a period apart, starting with the one at releasedAt */
+	unsigned long late = (clockTick - rt->releasedAt - rt->deadline - 1) / rt->period + 1;
+	return late < unfinished ? late : unfinished;
+}
+
+/**
+ * Creates a new semaphore with the supplied ID and value, 
+ * if the semaphore with that ID hasn't been initialized.
+ * The ceiling is the priority its owner runs at under the ceiling protocol, INIT for none.
+ * Returns the semaphore ID on success, -1 on failure.
+ */
+static int NewSemaphore(int id, int value, int ceiling) {
+	/* Check if semaphore ID is valid */
+	if (id < 0 || id >= MAX_SEMAPHORES) {
+		LOG_ERROR("Invalid semaphore ID specified. ID must be a value between 0 and %d.\n", 
+			MAX_SEMAPHORES - 1);
+		LOG_ERROR("Failed to initialize semaphore.\n");
+		return -1;
+	}
+
+	/* Check if semaphore has already been initialized */
+	if (GetSemaphore(id) != NULL) {
+		LOG_ERROR("The semaphore with ID %d has already been initialized.\n", id);
+		LOG_ERROR("Failed to initialize semaphore.\n");
+		return -1;
+	}
+
+	/* Check if semaphore value is appropriate */
+	if (value < 0) {
+		LOG_ERROR("The semaphore value %d is invalid. It must be 0 or greater.\n", value);
+		LOG_ERROR("Failed to initialize semaphore.\n");
+		return -1;
+	}
+	if (ceiling < HIGH || ceiling > INIT) {
+		LOG_ERROR("The priority ceiling %d is invalid. It must be between %d and %d, where %d means none.\n", 
+			ceiling, HIGH, INIT, INIT);
+		LOG_ERROR("Failed to initialize semaphore.\n");
+		return -1;
+	}
+
+	/* Make room for the ID in the semaphore table */
+	if (id >= semaphoreTableSize) {
+		int newSize = semaphoreTableSize ? semaphoreTableSize : SEMAPHORE_TABLE_INIT_SIZE;
+		while (newSize <= id) {
+			newSize *= 2;
+		}
+		SEMAPHORE **newTable = (SEMAPHORE **)realloc(semaphoreTable, sizeof(SEMAPHORE *) * newSize);
+		if (newTable == NULL) {
+			LOG_ERROR("Out of memory for the semaphore table.\n");
+			LOG_ERROR("Failed to initialize semaphore.\n");
+			return -1;
+		}
+		memset(newTable + semaphoreTableSize, 0, sizeof(SEMAPHORE *) * (newSize - semaphoreTableSize));
+		semaphoreTable = newTable;
+		semaphoreTableSize = newSize;
+	}
+
+	/* Initialize the semaphore struct */
+	SEMAPHORE *semaphore = (SEMAPHORE *)malloc(sizeof(SEMAPHORE));
+	if (semaphore == NULL) {
+		LOG_ERROR("Out of memory for semaphores.\n");
+		LOG_ERROR("Failed to initialize semaphore.\n");
+		return -1;
+	}
+	semaphore->id = id;
+	semaphore->value = value;
+	semaphore->owner = NULL;
+	semaphore->ceiling = (PRIORITY)ceiling;
+	memset(semaphore->waiting, 0, sizeof(semaphore->waiting));
+	semaphore->invertedSince = NOT_INVERTED;
+	semaphore->invertedPriority = INIT;
+
+	/* Initialize list of processes blocked on this semaphore */
+	IListInit(&semaphore->blockedList);
+
+	semaphoreTable[id] = semaphore;
+	LOG("Semaphore with ID %d and value %d created.\n", id, semaphore->value);
+	if (semaphore->ceiling != INIT) {
+		LOG("Its priority ceiling is %s.\n", PRIORITIES[semaphore->ceiling]);
+	}
+	return id;
+}
+
+/**
+ * Destroys the semaphore with the supplied ID so the ID can be initialized again.
+ * Every process still blocked on it is woken up, as if its P had succeeded.
+ * Returns the semaphore ID on success, -1 on failure.
+ */
+static int DestroySemaphore(int id) {
+	SEMAPHORE *semaphore = GetSemaphore(id);
+	if (semaphore == NULL) {
+		LOG_ERROR("The semaphore with ID %d has not been initialized.\n", id);
+		LOG_ERROR("Failed to destroy semaphore %d.\n", id);
+		return -1;
+	}
+
+	LOG("Waking up %d process(es) blocked on semaphore %d.\n", IListCount(&semaphore->blockedList), id);
+	while (IListCount(&semaphore->blockedList) > 0) {
+		PROCESS *procToWake = LINK_ITEM(semaphore->blockedList.head, PROCESS, semLink);
+		UnblockFromSemaphore(procToWake);
+		LOG("Waking up PID %d.\n", procToWake->pid);
+		EMIT_EVENT(EVENT_WAKE, procToWake->pid, currentCpu->running ? currentCpu->running->pid : -1);
+		AddProcessToReadyQueue(procToWake);
+	}
+	PROCESS *owner = DisownSemaphore(semaphore);
+	if (owner != NULL) {
+		UpdatePriority(owner);
+	}
+
+	semaphoreTable[id] = NULL;
+	free(semaphore);
+	LOG("Semaphore with ID %d destroyed.\n", id);
+	return id;
+}
+
+/**
+ * Implements the semaphore P function.
+ * If the running process blocks and timeout is positive, it gives up after that many ticks.
+ */
+static void P(int id, long timeout) {
+	/* Check if semaphore ID is valid */
+	if (id < 0 || id >= MAX_SEMAPHORES) {
+		LOG_ERROR("The semaphore ID %d is invalid. ID must be between 0-%d.\n", id, MAX_SEMAPHORES - 1);
+		LOG_ERROR("Failed to P on semaphore %d.\n", id);
+		return;
+	}
+
+	/* Check if semaphore is initialized */
+	SEMAPHORE *semaphore = GetSemaphore(id);
+	if (semaphore == NULL) {
+		LOG_ERROR("The semaphore with ID %d has not been initialized yet.\n", id);
+		LOG_ERROR("Failed to P on semaphore %d.\n", id);
+		return;
+	}
+
+	/* Check if there is a process running. Fail if there isn't. */
+	if (currentCpu->running == NULL) {
+		LOG_ERROR("There is no process currently running (all processes must be blocked).\n");
+		LOG_ERROR("Failed to P on semaphore %d.\n", id);
+		return;
+	}
+
+	semaphore->value--;
+	LOG("The semaphore value is now %d.\n", semaphore->value);
+	
+	/* Block the running process if the sem value is < 0 */
+	if (semaphore->value < 0) {
+		/* Blocking the INIT process is not allowed. Fail to P */
+		if (currentCpu->running->priority == INIT) {
+			LOG_ERROR("The INIT process is not allowed to be blocked.\n");
+			semaphore->value++;
+			LOG_ERROR("Reverting the semaphore value to %d.\n", semaphore->value);
+			LOG_ERROR("Failed to P on semaphore %d.\n", id);
+			return;
+		}
+
+		LOG("Blocking the running process (PID %d).\n", currentCpu->running->pid);
+		SetProcessState(currentCpu->running, BLOCKED_SEM);
+		EMIT_EVENT(EVENT_BLOCK_SEM, currentCpu->running->pid, id);
+
+		/* Add the process to the list of processes blocked on this sem. It's on no other queue. */
+		InsertWaiter(semaphore, currentCpu->running);
+		currentCpu->running->blockedSem = semaphore;
+		semaphore->waiting[currentCpu->running->basePriority]++;
+		numSemBlocked++;
+		CheckInversion(semaphore);
+		if (semaphore->owner != NULL) {
+			UpdatePriority(semaphore->owner);
+		}
+		if (timeout > 0) {
+			LOG("It will give up waiting at clock tick %lu.\n", clockTick + timeout);
+			currentCpu->running->timer.fire = SemTimeoutFired;
+			TimerAdd(&timerWheel, &currentCpu->running->timer, clockTick + timeout);
+		}
+
+		/* Select a new process to run */
+		LOG("Selecting a new process to run...\n");
+		SelectNewRunningProcess(currentCpu);
+	} else {
+		LOG("The semaphore value is still greater or equal to 0.\n");
+		LOG("The running process (PID %d) will not be blocked.\n", currentCpu->running->pid);
+		TakeSemaphore(semaphore, currentCpu->running);
+	}
+}
+
+/* Implements the semaphore V function */
+static void V(int id) {
+	/* Check if semaphore ID is valid */
+	if (id < 0 || id >= MAX_SEMAPHORES) {
+		LOG_ERROR("The semaphore ID %d is invalid. ID must be between 0-%d.\n", id, MAX_SEMAPHORES - 1);
+		LOG_ERROR("Failed to V on semaphore %d.\n", id);
+		return;
+	}
+
+	/* Check if semaphore is initialized */
+	SEMAPHORE *semaphore = GetSemaphore(id);
+	if (semaphore == NULL) {
+		LOG_ERROR("The semaphore with ID %d has not been initialized yet.\n", id);
+		LOG_ERROR("Failed to V on semaphore %d.\n", id);
+		return;
+	}
+
+	semaphore->value++;
+	LOG("The semaphore value is now %d.\n", semaphore->value);
+
+	/* Wake up a blocked process if the sem value is <= 0 */
+	if (semaphore->value <= 0) {
+		LOG("Waking up a process blocked on this semaphore.\n");
+		PROCESS *procToWake = LINK_ITEM(semaphore->blockedList.head, PROCESS, semLink);
+		UnblockFromSemaphore(procToWake);
+		LOG("This process has PID %d and priority %s.\n", 
+			procToWake->pid, PRIORITIES[procToWake->priority]);
+		EMIT_EVENT(EVENT_WAKE, procToWake->pid, currentCpu->running ? currentCpu->running->pid : -1);
+		procToWake->wokenAt = clockTick;
+		TakeSemaphore(semaphore, procToWake);
+		AddProcessToReadyQueue(procToWake);
+	} else {
+		LOG("The semaphore value is greater than 0.\n");
+		LOG("There are no blocked processes to wake up.\n");
+		if (semaphore->owner == currentCpu->running) {
+			UpdatePriority(DisownSemaphore(semaphore));
+		}
+	}
+}
+
+/** 
+ * Send a message to the PID specified.
+ * Both the message and PID are extracted from the user input buffer.
+ * The sender blocks until a reply is received if waitForReply is set, otherwise it keeps running
+ * and can't be replied to.
+ */
+static void Send(int waitForReply) {
+	/**
+	 * Find the PID. Separate the PID and message by finding the space in between them 
+	 * and null-terminating the end of the PID. 
+	 */
+	char *space = strchr(inputBuffer + 2, ' ');
+	if (space == NULL) {
+		LOG_ERROR("Expected a PID and a message separated by a space.\n");
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	}
+	char *inputMsg = space + 1;
+	*space = '\0';
+
+	/* Parse out the PID and validate it. */
+	int pid = atoi(inputBuffer + 2);
+	if (pid < 0 || pid >= nextAvailPid) {
+		LOG_ERROR("Invalid PID specified (%d).\n", pid);
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	}
+
+	/* Messages can only go to live processes, so none are left behind in a dead mailbox. */
+	if (GetProcByPid(pid) == NULL) {
+		LOG_ERROR("The process with PID %d was killed and removed from the OS.\n", pid);
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	}
+
+	/* Check if the message is a valid length. */
+	if (strlen(inputMsg) > MAX_MSG_LEN) {
+		LOG_ERROR("The message is too long. The max length is %d characters.\n", MAX_MSG_LEN);
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	} else if (!strlen(inputMsg)) {
+		LOG_ERROR("Empty messages can't be sent.\n");
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	}
+
+	SendMsg(pid, inputMsg, waitForReply);
+}
+
+/**
+ * Sends the text from the running process to a live process, blocking the sender until
+ * a reply is received if waitForReply is set. The text must fit in MAX_MSG_LEN.
+ */
+static void SendMsg(int pid, const char *text, int waitForReply) {
+	PROCESS *rcvProcess = GetProcByPid(pid);
+	if (rcvProcess == NULL) {
+		LOG_ERROR("There is no live process with PID %d.\n", pid);
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	}
+
+	/* Refuse the message rather than let a busy receiver queue without bound. The sender isn't blocked. */
+	if (MsgQueueFull(rcvProcess)) {
+		LOG_ERROR("The message queue of PID %d is full (%d messages).\n", pid, msgQueueCapacity);
+		LOG_ERROR("Failed to send the message.\n");
+		EMIT_EVENT(EVENT_MSG_REJECT, pid, currentCpu->running->pid);
+		return;
+	}
+
+	/* Build the message struct to send. */
+	LOG("Building the message to send to PID %d.\n", pid);
+	MSG *msg = NewMsg(NEW, currentCpu->running->pid, pid, text);
+	if (msg == NULL) {
+		LOG_ERROR("Out of memory for messages.\n");
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	}
+
+	/* Messages take msgDelay ticks to arrive */
+	if (msgDelay > 0) {
+		if (PutInFlight(msg) < 0) {
+			LOG_ERROR("Out of memory for messages.\n");
+			LOG_ERROR("Failed to send the message.\n");
+			FreeMsg(msg);
+			return;
+		}
+		LOG("The message will arrive at clock tick %lu.\n", clockTick + msgDelay);
+		rcvProcess->msgsInFlight++;
+	} else {
+		DeliverMsg(rcvProcess, msg);
+	}
+	currentCpu->running->stats.msgsSent++;
+
+	/* Block the sending process until a reply is received. */
+	if (!waitForReply) {
+		LOG("Asynchronous send. The sender (PID %d) keeps running.\n", currentCpu->running->pid);
+	} else if (currentCpu->running->priority != INIT) {
+		LOG("Blocking the sending process (PID %d) until a reply is received.\n", currentCpu->running->pid);
+		SetProcessState(currentCpu->running, BLOCKED_SEND);
+		currentCpu->running->sentAt = clockTick;
+		EMIT_EVENT(EVENT_BLOCK_SEND, currentCpu->running->pid, pid);
+		EnqueueProcess(&sendBlockedQueue, currentCpu->running);
+
+		/* Allow the next ready process to run. */
+		LOG("Selecting a new ready process to run.\n");
+		SelectNewRunningProcess(currentCpu);
+	} else {
+		/* Don't allow the INIT process to block. */
+		LOG("The sender is the INIT process. Cannot block the INIT process.\n");
+	}
+}
+
+/** 
+ * Receive up to maxMsgs messages from any process.
+ * The running process will immediately receive and print the oldest messages in its mailbox,
+ * if there are any.
+ * If its mailbox is empty, the process blocks until a message arrives if mayBlock is set,
+ * otherwise it keeps running.
+ */
+static void Receive(int maxMsgs, int mayBlock) {
+	/* Take the oldest messages from the running process's own mailbox. */
+	int received = 0;
+	for (LINK *msgLink; received < maxMsgs && (msgLink = IListPop(&currentCpu->running->mailbox)) != NULL; 
+			received++) {
+		MSG *foundMsg = LINK_ITEM(msgLink, MSG, link);
+		if (received == 0) {
+			LOG("There was a message already waiting in the mailbox of the running process (PID %d).\n", 
+				currentCpu->running->pid);
+		}
+		LOG("Message received from PID %d.\n", foundMsg->sendPid);
+		LOG("Message body: %s\n", foundMsg->text);
+
+		/* Return the received message to the pool */
+		EMIT_EVENT(EVENT_MSG_DEQUEUE, currentCpu->running->pid, foundMsg->sendPid);
+		currentCpu->running->stats.msgsReceived++;
+		currentCpu->running->lastSenderPid = foundMsg->sendPid;
+		FreeMsg(foundMsg);
+	}
+	if (received > 0) {
+		if (maxMsgs > 1) {
+			LOG("Received %d of up to %d messages.\n", received, maxMsgs);
+		}
+		return;
+	}
+
+	/* No message for the running process already in its mailbox. */
+	LOG("No message in the mailbox of the running process (PID %d).\n", currentCpu->running->pid);
+	if (!mayBlock) {
+		LOG("Not waiting for a message. The running process keeps running.\n");
+	} else if (currentCpu->running->priority != INIT) {
+		/* Block the process until a message is received for it. */
+		LOG("Blocking the running process (PID %d) until a message is received.\n", 
+			currentCpu->running->pid);
+		SetProcessState(currentCpu->running, BLOCKED_RCV);
+		EMIT_EVENT(EVENT_BLOCK_RCV, currentCpu->running->pid, -1);
+		EnqueueProcess(&rcvBlockedQueue, currentCpu->running);
+
+		/* Allow the next ready process to run. */
+		LOG("Selecting a new ready process to run.\n");
+		SelectNewRunningProcess(currentCpu);
+	} else {
+		/* INIT process not allowed to be blocked. */
+		LOG("The receiver is the INIT process. Cannot block the INIT process.\n");
+	}
+}
+
+/** 
+ * Reply to a process that sent a message.
+ * Will fail if a process attempts to reply to a process that isn't blocked
+ * on a send.
+ */
+static void Reply() {
 	/**
 	 * Find the PID. Separate the PID and message by finding the space in between them 
 	 * and null-terminating the end of the PID. 
 	 */
 	char *space = strchr(inputBuffer + 2, ' ');
+	if (space == NULL) {
+		LOG_ERROR("Expected a PID and a message separated by a space.\n");
+		LOG_ERROR("Failed to send the message.\n");
+		return;
+	}
 	char *inputMsg = space + 1;
 	*space = '\0';
 
 	/* Parse out the PID and validate it. */
 	int pid = atoi(inputBuffer + 2);
 	if (pid < 0 || pid >= nextAvailPid) {
-		printf("Invalid PID specified (%d).\n", pid);
-		printf("Failed to send the message.\n");
+		LOG_ERROR("Invalid PID specified (%d).\n", pid);
+		LOG_ERROR("Failed to send the message.\n");
 		return;
 	}
 
 	/* Check if the message is a valid length. */
 	if (strlen(inputMsg) > MAX_MSG_LEN) {
-		printf("The message is too long. The max length is 40 characters.\n");
-		printf("Failed to send the message.\n");
+		LOG_ERROR("The message is too long. The max length is %d characters.\n", MAX_MSG_LEN);
+		LOG_ERROR("Failed to send the message.\n");
 		return;
 	} else if (!strlen(inputMsg)) {
-		printf("Empty messages can't be sent.\n");
-		printf("Failed to send the message.\n");
+		LOG_ERROR("Empty messages can't be sent.\n");
+		LOG_ERROR("Failed to send the message.\n");
 		return;
 	}
 
-	PROCESS *replyProcess = SearchBlockedQueue(pid);
-	if (replyProcess && replyProcess->state == BLOCKED_SEND) {
-		printf("Replying to send blocked process with PID %d.\n", pid);
-		printf("Copying the message to the PCB of the receiver.\n");
+	ReplyMsg(pid, inputMsg);
+}
+
+/**
+ * Sends the text from the running process as the reply to a send blocked process.
+ * The text must fit in MAX_MSG_LEN.
+ */
+static void ReplyMsg(int pid, const char *text) {
+	PROCESS *replyProcess = GetProcByPid(pid);
+	if (replyProcess && replyProcess->replyInFlight) {
+		LOG_ERROR("Reply to PID %d failed. A reply to it is already on the way.\n", pid);
+	} else if (replyProcess && replyProcess->state == BLOCKED_SEND) {
+		LOG("Replying to send blocked process with PID %d.\n", pid);
+		LOG("Copying the message to the PCB of the receiver.\n");
 
 		/* Build the reply message, then copy it to the PCB of the receiver. */
-		MSG *msg = (MSG *)malloc(sizeof(MSG));
-		char *msgContent = (char *)malloc(sizeof(char) * (strlen(inputMsg) + 1));
-		strcpy(msgContent, inputMsg);
-		msg->rcvPid = pid;
-		msg->sendPid = runningProcess->pid;
-		msg->text = msgContent;
-		msg->type = REPLY;
-		replyProcess->msg = msg;
-
-		/* Unblock the reply receiver. */
-		printf("Waking up the receiver process and placing it on the ready queue.\n");
-		replyProcess->state = READY;
-		RemovePidFromBlockedQueue(replyProcess);
-		AddProcessToReadyQueue(replyProcess);
+		MSG *msg = NewMsg(REPLY, currentCpu->running->pid, pid, text);
+		if (msg == NULL) {
+			LOG_ERROR("Out of memory for messages.\n");
+			LOG_ERROR("Reply to PID %d failed.\n", pid);
+			return;
+		}
+		if (msgDelay > 0) {
+			if (PutInFlight(msg) < 0) {
+				LOG_ERROR("Out of memory for messages.\n");
+				LOG_ERROR("Reply to PID %d failed.\n", pid);
+				FreeMsg(msg);
+				return;
+			}
+			LOG("The reply will arrive at clock tick %lu.\n", clockTick + msgDelay);
+			replyProcess->replyInFlight = 1;
+		} else {
+			DeliverMsg(replyProcess, msg);
+		}
+		currentCpu->running->stats.msgsSent++;
 	} else {
-		printf("Reply to PID %d failed. It wasn't in the blocked queue, or it wasn't send blocked.\n",
+		LOG_ERROR("Reply to PID %d failed. It wasn't in the blocked queue, or it wasn't send blocked.\n",
 			pid);
 	}
 }
@@ -687,8 +1797,6 @@ static void ProcInfo(int pid) {
 	/* Check if the process is running or the INIT process, or if it's in a queue */
 	if (pid == 0) {
 		process = initProcess;
-	} else if (pid == runningProcess->pid) {
-		process = runningProcess;
 	} else {
 		process = GetProcByPid(pid);
 	}
@@ -701,301 +1809,1279 @@ static void ProcInfo(int pid) {
 
 	/* Print out all available info about the process */
 	printf("The process has priority %s.\n", PRIORITIES[process->priority]);
+	if (process->priority != process->basePriority) {
+		printf("It was raised from %s priority by the semaphores it owns.\n", PRIORITIES[process->basePriority]);
+	}
 	printf("The process is currently in the %s state.\n", STATES[process->state]);
+
+	/* Print the accounting counters, including time spent in the current state */
+	printf("Accounting at clock tick %lu (created at tick %lu):\n", clockTick, process->stats.createdAt);
+	printf("  Quanta run: %lu\n", process->stats.quantaRun);
+	printf("  Ticks ready: %lu\n", TimeInState(process, READY));
+	printf("  Ticks blocked on semaphores: %lu, sends: %lu, receives: %lu\n", 
+		TimeInState(process, BLOCKED_SEM), TimeInState(process, BLOCKED_SEND), 
+		TimeInState(process, BLOCKED_RCV));
+	printf("  Ticks sleeping: %lu\n", TimeInState(process, SLEEPING));
+	if (IS_REAL_TIME(process)) {
+		printf("  Real-time task on CPU %d: period %lu, WCET %lu, deadline %lu\n", process->sched.cpu, 
+			process->rt.period, process->rt.wcet, process->rt.deadline);
+		printf("  Jobs released: %lu, finished: %lu, missed deadlines: %lu, late unfinished: %lu\n", 
+			process->rt.jobsReleased, process->rt.jobsDone, process->rt.misses, LateJobs(process));
+		printf("  Worst response time: %lu, next release at tick %lu\n", process->rt.worstResponse, 
+			process->rt.timer.expires);
+	}
+	if (IListCount(&process->ownedSems) > 0) {
+		printf("  Semaphores owned: ");
+		ILIST_FOR_EACH(link, &process->ownedSems) {
+			printf("%d, ", LINK_ITEM(link, SEMAPHORE, ownerLink)->id);
+		}
+		printf("\n");
+	}
+	if (process->nextOp != NULL) {
+		printf("  Workload steps left: %ld, next: %s\n", (long)(process->endOp - process->nextOp), 
+			process->nextOp < process->endOp ? WL_OP_NAMES[process->nextOp->type] : "exit");
+	}
+	printf("  Context switches: %lu\n", process->stats.contextSwitches);
+	printf("  Messages sent: %lu, received: %lu\n", process->stats.msgsSent, process->stats.msgsReceived);
 }
 
 /* Prints status of all the process queues to the terminal */
 static void TotalInfo() {
-	printf("High priority processes in queue: ");
-	if (ListCount(highReadyQueue) == 0) {
+	for (int cpuIndex = 0; cpuIndex < numCpus; cpuIndex++) {
+		RUNQUEUE *runQueue = &cpus[cpuIndex].runQueue;
+		RUNQUEUE *rtQueue = &cpus[cpuIndex].rtQueue;
+		if (numCpus > 1) {
+			printf("CPU %d:\n", cpuIndex);
+		}
+		if (numRtTasks > 0) {
+			printf("Real-time tasks in queue (PID:%s): ", rtPolicy->keyName);
+			if (rtQueue->count == 0) {
+				printf("NONE\n");
+			} else {
+				for (int i = 0; i < rtQueue->count; i++) {
+					printf("%d:%llu, ", rtQueue->heap[i]->pid, rtQueue->heap[i]->sched.key);
+				}
+				printf("\n");
+			}
+		}
+		if (policy->keyName == NULL) {
+			for (int level = 0; level < NUM_RUN_LEVELS; level++) {
+				printf("%s priority processes in queue: ", PRIORITIES[level]);
+				if (IListCount(&runQueue->levels[level]) == 0) {
+					printf("NONE\n");
+				} else {
+					ILIST_FOR_EACH(link, &runQueue->levels[level]) {
+						PROCESS *process = LINK_ITEM(link, PROCESS, queueLink);
+						printf("%d, ", process->pid);
+					}
+					printf("\n");
+				}
+			}
+		} else {
+			/* Heap order: the first process runs next, the rest aren't sorted */
+			printf("Ready processes (PID:%s): ", policy->keyName);
+			if (runQueue->count == 0) {
+				printf("NONE\n");
+			} else {
+				for (int i = 0; i < runQueue->count; i++) {
+					printf("%d:%llu, ", runQueue->heap[i]->pid, runQueue->heap[i]->sched.key);
+				}
+				printf("\n");
+			}
+		}
+	}
+
+	printf("Send blocked processes in queue: ");
+	if (IListCount(&sendBlockedQueue) == 0) {
 		printf("NONE\n");
 	} else {
-		ListFirst(highReadyQueue);
-		for (int i = 0; i < ListCount(highReadyQueue); i++) {
-			PROCESS *process = (PROCESS *)ListCurr(highReadyQueue);
+		ILIST_FOR_EACH(link, &sendBlockedQueue) {
+			PROCESS *process = LINK_ITEM(link, PROCESS, queueLink);
 			printf("%d, ", process->pid);
-			ListNext(highReadyQueue);
 		}
 		printf("\n");
 	}
 
-	printf("Normal priority processes in queue: ");
-	if (ListCount(normalReadyQueue) == 0) {
+	printf("Receive blocked processes in queue: ");
+	if (IListCount(&rcvBlockedQueue) == 0) {
 		printf("NONE\n");
 	} else {
-		ListFirst(normalReadyQueue);
-		for (int i = 0; i < ListCount(normalReadyQueue); i++) {
-			PROCESS *process = (PROCESS *)ListCurr(normalReadyQueue);
+		ILIST_FOR_EACH(link, &rcvBlockedQueue) {
+			PROCESS *process = LINK_ITEM(link, PROCESS, queueLink);
 			printf("%d, ", process->pid);
-			ListNext(normalReadyQueue);
 		}
 		printf("\n");
 	}
 
-	printf("Low priority processes in queue: ");
-	if (ListCount(lowReadyQueue) == 0) {
+	printf("Semaphore blocked processes: ");
+	if (numSemBlocked == 0) {
 		printf("NONE\n");
 	} else {
-		ListFirst(lowReadyQueue);
-		for (int i = 0; i < ListCount(lowReadyQueue); i++) {
-			PROCESS *process = (PROCESS *)ListCurr(lowReadyQueue);
-			printf("%d, ", process->pid);
-			ListNext(lowReadyQueue);
-		}
 		printf("\n");
+		for (int id = 0; id < semaphoreTableSize; id++) {
+			if (semaphoreTable[id] == NULL || IListCount(&semaphoreTable[id]->blockedList) == 0) {
+				continue;
+			}
+			printf("  Semaphore %d: ", id);
+			if (semProtocol != SEM_NONE && semaphoreTable[id]->owner != NULL) {
+				printf("(owner %d) ", semaphoreTable[id]->owner->pid);
+			}
+			ILIST_FOR_EACH(link, &semaphoreTable[id]->blockedList) {
+				PROCESS *process = LINK_ITEM(link, PROCESS, semLink);
+				printf("%d, ", process->pid);
+			}
+			printf("\n");
+		}
 	}
 
-	printf("Blocked processes in queue: ");
-	if (ListCount(blockedQueue) == 0) {
-		printf("NONE\n\n");
+	printf("Sleeping processes (PID:wake tick): ");
+	if (numSleeping == 0) {
+		printf("NONE\n");
 	} else {
-		ListFirst(blockedQueue);
-		for (int i = 0; i < ListCount(blockedQueue); i++) {
-			PROCESS *process = (PROCESS *)ListCurr(blockedQueue);
-			printf("%d, ", process->pid);
-			ListNext(blockedQueue);
+		for (int pid = 0; pid < nextAvailPid; pid++) {
+			PROCESS *sleeper = pidTable[pid];
+			if (sleeper != NULL && sleeper->state == SLEEPING) {
+				printf("%d:%lu, ", pid, IS_REAL_TIME(sleeper) ? sleeper->rt.timer.expires : sleeper->timer.expires);
+			}
 		}
-		printf("\n\n");
+		printf("\n");
 	}
+	printf("\n");
 
-	if (runningProcess != NULL) {
+	for (int cpuIndex = 0; cpuIndex < numCpus; cpuIndex++) {
+		PROCESS *running = cpus[cpuIndex].running;
+		if (numCpus > 1) {
+			printf("CPU %d: ", cpuIndex);
+		}
 		printf("Running process - PID: %d, Priority: %s, State: %s\n", 
-			runningProcess->pid, PRIORITIES[runningProcess->priority], STATES[runningProcess->state]);
-	} else {
-		printf("Running process: NONE\n");
+			running->pid, PRIORITIES[running->priority], STATES[running->state]);
 	}
 	printf("Init process - PID: %d, Priority: %s, State: %s\n", 
 		initProcess->pid, PRIORITIES[initProcess->priority], STATES[initProcess->state]);
-}
 
-/***************************************************************
- * Helper Functions                                            *
- ***************************************************************/
+	/* Accounting for every live process */
+	printf("\nClock tick: %lu, context switches: %lu\n", clockTick, TotalContextSwitches());
+	printf("PID\tPRIO\tQUANTA\tREADY\tSEM\tSEND\tRCV\tSLEEP\tSWITCH\tSENT\tRCVD\n");
+	for (int pid = 0; pid < nextAvailPid; pid++) {
+		PROCESS *process = pidTable[pid];
+		if (process == NULL) {
+			continue;
+		}
+		printf("%d\t%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n", process->pid, 
+			PRIORITIES[process->priority], process->stats.quantaRun, TimeInState(process, READY), 
+			TimeInState(process, BLOCKED_SEM), TimeInState(process, BLOCKED_SEND), 
+			TimeInState(process, BLOCKED_RCV), TimeInState(process, SLEEPING), process->stats.contextSwitches, 
+			process->stats.msgsSent, process->stats.msgsReceived);
+	}
 
-/* Adds a process to the appropriate ready queue based on priority */
-static void AddProcessToReadyQueue(PROCESS *process) {
-	process->state = READY;
-	switch (process->priority) {
-		case HIGH:
-			ListAppend(highReadyQueue, process);
-			return;
-		case NORMAL:
-			ListAppend(normalReadyQueue, process);
-			return;
-		case LOW:
-			ListAppend(lowReadyQueue, process);
-			return;
-		case INIT:
-			initProcess = process;
-			runningProcess = process;
-			break;
-		default:
-			break;
+	/* Load balancing across CPUs */
+	if (numCpus > 1) {
+		printf("\nCPU\tREADY\tBUSY\tIDLE\tSWITCH\tSTEALS\tSTOLEN\n");
+		for (int cpuIndex = 0; cpuIndex < numCpus; cpuIndex++) {
+			CPU *cpu = &cpus[cpuIndex];
+			printf("%d\t%d\t%lu\t%lu\t%lu\t%lu\t%lu\n", cpu->id, cpu->runQueue.count, 
+				cpu->stats.busyTicks, cpu->stats.idleTicks, cpu->stats.contextSwitches, 
+				cpu->stats.steals, cpu->stats.stolenFrom);
+		}
+	}
+
+	if (numRtTasks > 0) {
+		PrintRealTime();
 	}
 }
 
-/* Checks the priorities queues to select which process to run next */
-static void SelectNewRunningProcess() {
-	/* Check queues in priority order to see which should run */
-	if (ListCount(highReadyQueue) > 0) {
-		printf("Getting new process from HIGH priority queue...\n");
-		PROCESS *newRunningProc = ListFirst(highReadyQueue);
-		ListRemove(highReadyQueue);
-		runningProcess = newRunningProc;
-		runningProcess->state = RUNNING;
-		printf("The new running process has PID %d.\n", runningProcess->pid);
-		HandleMsgIfReceived();
-		return;
+/**
+ * Prints a table of the live real-time tasks, then the real-time utilization of each CPU.
+ * UTIL is the share of the CPU a task has had since it was created; WCET / PERIOD is what it asks for.
+ */
+static void PrintRealTime() {
+	printf("\nReal-time tasks (%s policy):\n", rtPolicy->name);
+	printf("PID\tCPU\tPERIOD\tWCET\tDEADLN\tJOBS\tDONE\tMISSED\tLATE\tWORST\tUTIL\n");
+	for (int pid = 0; pid < nextAvailPid; pid++) {
+		PROCESS *task = pidTable[pid];
+		if (task == NULL || !IS_REAL_TIME(task)) {
+			continue;
+		}
+		unsigned long ticksRun = task->rt.jobsDone * task->rt.wcet;
+		if (task->rt.jobsReleased > task->rt.jobsDone) {
+			unsigned long running = task->state == RUNNING ? clockTick - task->burstSince : 0;
+			ticksRun += task->rt.wcet - task->burstLeft + (running < task->burstLeft ? running : task->burstLeft);
+		}
+		unsigned long lifetime = clockTick - task->stats.createdAt;
+		printf("%d\t%d\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%.3f\n", task->pid, task->sched.cpu, 
+			task->rt.period, task->rt.wcet, task->rt.deadline, task->rt.jobsReleased, task->rt.jobsDone, 
+			task->rt.misses, LateJobs(task), task->rt.worstResponse, 
+			lifetime > 0 ? (double)ticksRun / (double)lifetime : 0.0);
+	}
+	for (int cpuIndex = 0; cpuIndex < numCpus; cpuIndex++) {
+		double density;
+		double hyperbolic;
+		int implicit;
+		double utilization = RtUtilization(cpuIndex, &density, &hyperbolic, &implicit);
+		printf("CPU %d real-time utilization: %.3f, density: %.3f\n", cpuIndex, utilization, density);
+	}
+}
+
+/**
+ * Prints the latency histograms of all CPUs merged, one row per kind and priority that saw
+ * any values. Percentiles are in ticks and within 1/16 of the exact value.
+ */
+static void PrintLatencies(FILE *out) {
+	static const char * const LATENCY_NAMES[NUM_LATENCY_KINDS] = {"ready", "wakeup", "roundtrip", "inversion"};
+
+	fprintf(out, "KIND\tPRIO\tCOUNT\tMEAN\tP50\tP90\tP99\tP99.9\tMAX\n");
+	for (int kind = 0; kind < NUM_LATENCY_KINDS; kind++) {
+		for (int level = 0; level < NUM_RUN_LEVELS; level++) {
+			HISTOGRAM merged = {0};
+			for (int cpuIndex = 0; cpuIndex < numCpus; cpuIndex++) {
+				HistMerge(&merged, &cpus[cpuIndex].latency[kind][level]);
+			}
+			PrintLatencyRow(out, LATENCY_NAMES[kind], PRIORITIES[level], &merged);
+		}
+	}
+
+	HISTOGRAM response = {0};
+	for (int cpuIndex = 0; cpuIndex < numCpus; cpuIndex++) {
+		HistMerge(&response, &cpus[cpuIndex].rtResponse);
 	}
-	if (ListCount(normalReadyQueue) > 0) {
-		printf("Getting new process from NORMAL priority queue...\n");
-		PROCESS *newRunningProc = ListFirst(normalReadyQueue);
-		ListRemove(normalReadyQueue);
-		runningProcess = newRunningProc;
-		runningProcess->state = RUNNING;
-		printf("The new running process has PID %d.\n", runningProcess->pid);
-		HandleMsgIfReceived();
+	PrintLatencyRow(out, "response", "RT", &response);
+}
+
+/* Prints one row of the latency table, or nothing if no values were recorded */
+static void PrintLatencyRow(FILE *out, const char *kind, const char *priority, const HISTOGRAM *hist) {
+	if (hist->total == 0) {
 		return;
 	}
-	if (ListCount(lowReadyQueue) > 0) {
-		printf("Getting new process from LOW priority queue...\n");
-		PROCESS *newRunningProc = ListFirst(lowReadyQueue);
-		ListRemove(lowReadyQueue);
-		runningProcess = newRunningProc;
-		runningProcess->state = RUNNING;
-		printf("The new running process has PID %d.\n", runningProcess->pid);
-		HandleMsgIfReceived();
+	fprintf(out, "%s\t%s\t%llu\t%.1f\t%llu\t%llu\t%llu\t%llu\t%llu\n", kind, priority, 
+		(unsigned long long)hist->total, HistMean(hist), 
+		(unsigned long long)HistPercentile(hist, 50), (unsigned long long)HistPercentile(hist, 90), 
+		(unsigned long long)HistPercentile(hist, 99), (unsigned long long)HistPercentile(hist, 99.9), 
+		(unsigned long long)hist->max);
+}
+
+/***************************************************************
+ * Helper Functions                                            *
+ ***************************************************************/
+
+/* Adds a process to the ready queue chosen by the scheduling policy, on the CPU it last used */
+static void AddProcessToReadyQueue(PROCESS *process) {
+	SetProcessState(process, READY);
+	if (process->priority == INIT) {
+		initProcess = process;
 		return;
 	}
 
-	/* If there are no ready processes, let the INIT process run IF it's not blocked */
-	printf("No processes on ready queues. Checking if the INIT process is ready...\n");
-	if (initProcess->state == READY || initProcess->state == RUNNING) {
-		printf("The INIT process is now running.\n");
-		runningProcess = initProcess;
-		HandleMsgIfReceived();
+	if (IS_REAL_TIME(process)) {
+		rtPolicy->enqueue(&cpus[process->sched.cpu].rtQueue, process, clockTick);
 	} else {
-		printf("The INIT process is blocked. No process is available to run.\n");
-		runningProcess = NULL;
+		policy->enqueue(&cpus[process->sched.cpu].runQueue, process, clockTick);
 	}
+	EMIT_EVENT(EVENT_READY, process->pid, process->sched.level);
+}
 
-	return;
+/**
+ * Asks the scheduling policies which ready process the CPU runs next, a real-time task first.
+ * If the CPU's runqueues are empty it steals from the busiest CPU, and failing that runs its idle process.
+ */
+static void SelectNewRunningProcess(CPU *cpu) {
+	PROCESS *newRunningProc = PickLocalNext(cpu);
+	if (newRunningProc == NULL && numCpus > 1) {
+		newRunningProc = StealProcess(cpu);
+	}
+	DispatchProcess(cpu, newRunningProc);
 }
 
-/* Returns 0 if the processes PIDs don't match, 1 if the PIDs do match */
-static int PidComparator(void *proc1, void *proc2) {
-	PROCESS *process1 = (PROCESS *)proc1;
-	PROCESS *process2 = (PROCESS *)proc2;
-	return process1->pid == process2->pid;
+/**
+ * Switches the CPU to the process, or to its idle process if it is NULL, 
+ * and displays any messages delivered to the process while it wasn't running.
+ */
+static void DispatchProcess(CPU *cpu, PROCESS *newRunningProc) {
+	if (newRunningProc != NULL) {
+		if (IS_REAL_TIME(newRunningProc)) {
+			LOG("Getting the real-time task with the lowest %s (%llu)...\n", rtPolicy->keyName, 
+				newRunningProc->sched.key);
+		} else if (policy->keyName == NULL) {
+			LOG("Getting new process from %s priority queue...\n", PRIORITIES[newRunningProc->sched.level]);
+		} else {
+			LOG("Getting the process with the lowest %s (%llu)...\n", policy->keyName, 
+				newRunningProc->sched.key);
+		}
+	} else {
+		/* If there are no ready processes, let the idle process run */
+		LOG("No processes on ready queues. Checking if the INIT process is ready...\n");
+		LOG("The INIT process is now running.\n");
+		newRunningProc = cpu->idle;
+	}
+
+	if (newRunningProc != cpu->running) {
+		newRunningProc->stats.contextSwitches++;
+		cpu->stats.contextSwitches++;
+	}
+	cpu->running = newRunningProc;
+	SetProcessState(newRunningProc, RUNNING);
+	EMIT_EVENT(EVENT_RUN, newRunningProc->pid, newRunningProc->sched.level);
+	if (newRunningProc->priority != INIT) {
+		LOG("The new running process has PID %d.\n", newRunningProc->pid);
+	}
+	HandleMsgIfReceived(newRunningProc);
+}
+
+/**
+ * Takes the next process from the CPU with the most ready processes, and moves it to the thief.
+ * Real-time tasks are never stolen; they stay on the CPU they were placed on.
+ * Returns NULL if no other CPU has a ready process.
+ */
+static PROCESS *StealProcess(CPU *thief) {
+	CPU *victim = NULL;
+	for (int i = 0; i < numCpus; i++) {
+		if (&cpus[i] != thief && cpus[i].runQueue.count > 0 && 
+				(victim == NULL || cpus[i].runQueue.count > victim->runQueue.count)) {
+			victim = &cpus[i];
+		}
+	}
+	if (victim == NULL) {
+		return NULL;
+	}
+
+	PROCESS *process = policy->pickNext(&victim->runQueue);
+	SchedMigrate(process, &victim->runQueue, &thief->runQueue);
+	process->sched.cpu = thief->id;
+	thief->stats.steals++;
+	victim->stats.stolenFrom++;
+	LOG("CPU %d stole PID %d from CPU %d.\n", thief->id, process->pid, victim->id);
+	EMIT_EVENT(EVENT_STEAL, process->pid, victim->id);
+	return process;
+}
+
+/* Returns the CPU with the fewest ready and running processes, where new processes are placed */
+static CPU *LeastLoadedCpu() {
+	CPU *best = &cpus[0];
+	int bestLoad = INT_MAX;
+	for (int i = 0; i < numCpus; i++) {
+		int load = cpus[i].runQueue.count + cpus[i].rtQueue.count + (cpus[i].running != cpus[i].idle);
+		if (load < bestLoad) {
+			best = &cpus[i];
+			bestLoad = load;
+		}
+	}
+	return best;
+}
+
+/* Returns the number of ready processes on every CPU */
+static int TotalReadyProcesses() {
+	int total = 0;
+	for (int i = 0; i < numCpus; i++) {
+		total += cpus[i].runQueue.count + cpus[i].rtQueue.count;
+	}
+	return total;
+}
+
+/* Returns the number of ready processes the CPU could run: its own, and the ones it could steal */
+static int RunnableProcesses(CPU *cpu) {
+	int total = cpu->rtQueue.count;
+	for (int i = 0; i < numCpus; i++) {
+		total += cpus[i].runQueue.count;
+	}
+	return total;
 }
 
-/* Returns 0 if the message receiver PIDs don't match, 1 if the PIDs do match */
-static int MsgComparator(void *msg1, void *msg2) {
-	MSG *message1 = (MSG *)msg1;
-	MSG *message2 = (MSG *)msg2;
-	return message1->rcvPid == message2->rcvPid;
+/* Takes the next ready process off the CPU's own runqueues, a real-time task first, or returns NULL */
+static PROCESS *PickLocalNext(CPU *cpu) {
+	PROCESS *process = rtPolicy->pickNext(&cpu->rtQueue);
+	return process != NULL ? process : policy->pickNext(&cpu->runQueue);
 }
 
 /**
- * Returns a pointer to the process with the specified PID, if it is found.
- * Returns NULL if no process was found.
+ * Sets up numCpus CPUs, each with an empty runqueue. CPU 0 gets the INIT process as its idle
+ * process once it is created; the others get idle processes of their own, without a PID.
+ * Returns 0 on success, -1 if out of memory.
  */
-static PROCESS *GetProcByPid(int pid) {
-	PROCESS *procToFind = (PROCESS *)malloc(sizeof(PROCESS));
-	procToFind->pid = pid;
+static int InitCpus() {
+	cpus = (CPU *)calloc(numCpus, sizeof(CPU));
+	if (cpus == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < numCpus; i++) {
+		cpus[i].id = i;
+		RunQueueInit(&cpus[i].runQueue);
+		RunQueueInit(&cpus[i].rtQueue);
+		TimerInit(&cpus[i].burstTimer, BurstTimerFired);
+		if (i == 0) {
+			continue;
+		}
+		PROCESS *idle = (PROCESS *)calloc(1, sizeof(PROCESS));
+		if (idle == NULL) {
+			return -1;
+		}
+		idle->priority = INIT;
+		idle->basePriority = INIT;
+		idle->state = RUNNING;
+		idle->pid = IDLE_PID;
+		IListInit(&idle->mailbox);
+		IListInit(&idle->pendingMsgs);
+		SchedInitEntity(idle);
+		idle->sched.cpu = i;
+		cpus[i].idle = idle;
+		cpus[i].running = idle;
+	}
+	currentCpu = &cpus[0];
+	return 0;
+}
+
+/**
+ * Pre-empts the CPU's running process. Anything but the idle process goes back on the CPU's runqueue.
+ * Only touches the CPU's own runqueue, so CPU threads can run it at the same time.
+ */
+static void PreemptCpu(CPU *cpu) {
+	PROCESS *preempted = cpu->running;
+	if (numCpus > 1) {
+		LOG("CPU %d:\n", cpu->id);
+	}
+	preempted->stats.quantaRun++;
+	EMIT_EVENT(EVENT_QUANTUM, preempted->pid, preempted->priority);
+
+	if (IS_REAL_TIME(preempted)) {
+		cpu->stats.busyTicks++;
+		rtPolicy->quantum(&cpu->rtQueue, preempted, clockTick);
+		policy->quantum(&cpu->runQueue, NULL, clockTick);
+		LOG("Adding real-time task PID %d back to the real-time queue.\n", preempted->pid);
+		AddProcessToReadyQueue(preempted);
+	} else if (preempted->priority != INIT) {
+		cpu->stats.busyTicks++;
+		policy->quantum(&cpu->runQueue, preempted, clockTick);
+		LOG("Adding process PID %d back to %s priority ready queue.\n", 
+			preempted->pid, PRIORITIES[preempted->sched.level]);
+		AddProcessToReadyQueue(preempted);
+	} else {
+		cpu->stats.idleTicks++;
+		policy->quantum(&cpu->runQueue, NULL, clockTick);
+		LOG("The running process was the INIT process. Not adding to ready queue...\n");
+		SetProcessState(preempted, READY);
+	}
+}
+
+/**
+ * Runs the next process on the CPU's own runqueues, if it has one. Stealing is left to the caller,
+ * so CPU threads can run this at the same time.
+ */
+static void PickLocalProcess(CPU *cpu) {
+	PROCESS *newRunningProc = PickLocalNext(cpu);
+	if (newRunningProc != NULL) {
+		if (numCpus > 1) {
+			LOG("CPU %d:\n", cpu->id);
+		}
+		DispatchProcess(cpu, newRunningProc);
+	}
+}
 
-	PROCESS *foundProc = NULL;
-	ListFirst(highReadyQueue);
-	foundProc = ListSearch(highReadyQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		return foundProc;
+/**
+ * Runs the coming quantum expiries on the CPU threads, each CPU through all of them in one go,
+ * if BatchableQuanta allows enough of them. What the threads printed is written out afterwards
+ * phase by phase in CPU order, so the output is the same as expiring the quanta one at a time.
+ * Returns 1 if a batch was run, 0 if the quanta are left to the command thread.
+ */
+static int RunQuantaOnCpuThreads(unsigned long until) {
+	unsigned long quanta = BatchableQuanta(until);
+	if (quanta == 0) {
+		return 0;
 	}
 
-	ListFirst(normalReadyQueue);
-	foundProc = ListSearch(normalReadyQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		return foundProc;
+	batchFirstTick = quantumTimer.expires;
+	batchQuanta = quanta;
+	quantaBatched += quanta;
+	numBatches++;
+	TimerCancel(&timerWheel, &quantumTimer);
+	pthread_barrier_wait(&cpuWorkStart);
+	pthread_barrier_wait(&cpuWorkDone);
+
+	if (verbosity >= VERBOSITY_ERRORS || eventOutput) {
+		for (unsigned long quantum = 0; quantum < quanta; quantum++) {
+			LOG("Time quantum expired (clock tick %lu).\n", batchFirstTick + quantum * quantumTicks);
+			for (unsigned long phase = quantum * BATCH_PHASES; phase < (quantum + 1) * BATCH_PHASES; phase++) {
+				for (int i = 0; i < numCpus; i++) {
+					CPU_THREAD *thread = &cpuThreads[i];
+					size_t start = phase == 0 ? 0 : thread->phaseEnds[phase - 1];
+					fwrite(thread->logBuffer + start, 1, thread->phaseEnds[phase] - start, stdout);
+				}
+			}
+		}
+		for (int i = 0; i < numCpus; i++) {
+			rewind(cpuThreads[i].logStream);
+		}
+	}
+	for (LINK *msgLink = MpscTakeAll(&msgReturnQueue); msgLink != NULL; ) {
+		LINK *next = msgLink->next;
+		IListPrepend(&msgFreeList, msgLink);
+		msgLink = next;
 	}
 
-	ListFirst(lowReadyQueue);
-	foundProc = ListSearch(lowReadyQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		ListRemove(lowReadyQueue);
-		free(foundProc);
-		return foundProc;
+	/* Catch the wheel up as if the quantum timer had fired at every quantum of the batch */
+	clockTick = batchFirstTick + (quanta - 1) * quantumTicks;
+	TimerAdvance(&timerWheel, clockTick);
+	timerWheel.fired += quanta;
+	TimerAdd(&timerWheel, &quantumTimer, clockTick + quantumTicks);
+	return 1;
+}
+
+/**
+ * Returns how many quanta from the next one on can be run ahead, at least CPU_BATCH_MIN_QUANTA,
+ * or 0. Running ahead needs every expiry up to until to be a quantum's, with no workload or
+ * real-time task to step in between. No CPU may be able to steal either, which holds while no
+ * CPU is empty or none has a process to spare, as a run of quanta only turns processes over.
+ */
+static unsigned long BatchableQuanta(unsigned long until) {
+	if (workloadPids != NULL || numRtTasks > 0 || !TimerPending(&quantumTimer) || quantumTimer.expires > until) {
+		return 0;
+	}
+	unsigned long other = TimerNextTickWithout(&timerWheel, &quantumTimer);
+	unsigned long last = other <= until ? other - 1 : until;
+	if (last < quantumTimer.expires) {
+		return 0;
+	}
+	unsigned long quanta = (last - quantumTimer.expires) / quantumTicks + 1;
+	if (quanta < CPU_BATCH_MIN_QUANTA) {
+		return 0;
 	}
 
-	ListFirst(blockedQueue);
-	foundProc = ListSearch(blockedQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		ListRemove(blockedQueue);
-		free(foundProc);
-		return foundProc;
+	int anyEmpty = 0;
+	int anySpare = 0;
+	for (int i = 0; i < numCpus; i++) {
+		int load = cpus[i].runQueue.count + (cpus[i].running != cpus[i].idle);
+		anyEmpty |= load == 0;
+		anySpare |= load > 1;
+	}
+	if (anyEmpty && anySpare) {
+		return 0;
 	}
+	return quanta < CPU_BATCH_MAX_QUANTA ? quanta : CPU_BATCH_MAX_QUANTA;
+}
+
+/**
+ * Runs the batch of quanta on one CPU thread's CPU. At each one the CPU pre-empts its running
+ * process and runs the next from its own runqueue, or its idle process if that is empty.
+ * The log length after each phase is recorded, so the command thread can write it out in order.
+ */
+static void RunBatchOnCpu(CPU_THREAD *thread) {
+	CPU *cpu = thread->cpu;
+	int logging = verbosity >= VERBOSITY_ERRORS || eventOutput;
+	size_t *phaseEnd = thread->phaseEnds;
+	for (unsigned long quantum = 0; quantum < batchQuanta; quantum++) {
+		clockTick = batchFirstTick + quantum * quantumTicks;
+		for (int phase = 0; phase < BATCH_PHASES; phase++) {
+			if (phase == 0) {
+				PreemptCpu(cpu);
+			} else if (phase == 1) {
+				PickLocalProcess(cpu);
+			} else if (cpu->running->state != RUNNING) {
+				if (numCpus > 1) {
+					LOG("CPU %d:\n", cpu->id);
+				}
+				DispatchProcess(cpu, NULL);
+			}
+			if (logging) {
+				fflush(thread->logStream);
+				*phaseEnd++ = thread->logLength;
+			}
+		}
+	}
+}
+
+/**
+ * Starts a host thread per CPU. The command thread keeps everything else, and only releases
+ * the CPU threads through RunQuantaOnCpuThreads, while it waits for them.
+ * Returns 0 on success, -1 on failure.
+ */
+static int StartCpuThreads() {
+	cpuThreads = (CPU_THREAD *)calloc(numCpus, sizeof(CPU_THREAD));
+	if (cpuThreads == NULL || 
+			pthread_barrier_init(&cpuWorkStart, NULL, numCpus + 1) != 0 ||
+			pthread_barrier_init(&cpuWorkDone, NULL, numCpus + 1) != 0) {
+		return -1;
+	}
+	for (int i = 0; i < numCpus; i++) {
+		CPU_THREAD *thread = &cpuThreads[i];
+		thread->cpu = &cpus[i];
+		thread->logStream = open_memstream(&thread->logBuffer, &thread->logLength);
+		thread->phaseEnds = (size_t *)malloc(sizeof(size_t) * CPU_BATCH_MAX_QUANTA * BATCH_PHASES);
+		if (thread->logStream == NULL || thread->phaseEnds == NULL || pthread_create(&thread->thread, NULL, CpuThreadMain, thread) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
 
+/* Body of a CPU thread. It runs until the simulation exits. */
+static void *CpuThreadMain(void *arg) {
+	cpuThread = (CPU_THREAD *)arg;
+	while (1) {
+		pthread_barrier_wait(&cpuWorkStart);
+		RunBatchOnCpu(cpuThread);
+		pthread_barrier_wait(&cpuWorkDone);
+	}
 	return NULL;
 }
 
+/* Returns the context switches of all the CPUs together */
+static unsigned long TotalContextSwitches() {
+	unsigned long total = 0;
+	for (int i = 0; i < numCpus; i++) {
+		total += cpus[i].stats.contextSwitches;
+	}
+	return total;
+}
+
+/**
+ * Moves a process to a new state, first adding the time spent in the old one to its counters.
+ */
+static void SetProcessState(PROCESS *process, STATE state) {
+	unsigned long elapsed = clockTick - process->stats.stateSince;
+	if (process->state == READY) {
+		process->stats.readyTime += elapsed;
+	} else if (process->state >= BLOCKED_SEM) {
+		process->stats.blockedTime[process->state - BLOCKED_SEM] += elapsed;
+	}
+
+	/**
+	 * Latencies are recorded on the process's own CPU, so CPU threads never share a histogram,
+	 * and under its base priority, so a raised process still counts towards its own level.
+	 */
+	if (state == RUNNING && process->priority != INIT && !IS_REAL_TIME(process)) {
+		CPU *cpu = &cpus[process->sched.cpu];
+		if (process->state == READY) {
+			HistRecord(&cpu->latency[LATENCY_READY][process->basePriority], elapsed);
+		}
+		if (process->wokenAt != NOT_WOKEN) {
+			HistRecord(&cpu->latency[LATENCY_WAKEUP][process->basePriority], clockTick - process->wokenAt);
+			process->wokenAt = NOT_WOKEN;
+		}
+	}
+
+	/* A workload process or real-time job only gets through its CPU burst while it runs */
+	if (process->endOp != NULL || IS_REAL_TIME(process)) {
+		if (process->state == RUNNING) {
+			ChargeBurst(process);
+		}
+		process->burstSince = clockTick;
+	}
+	if (process->endOp != NULL && WAITS_ON_PROCESS(state) != WAITS_ON_PROCESS(process->state)) {
+		workloadWaiting += WAITS_ON_PROCESS(state) ? 1 : -1;
+	}
+	process->state = state;
+	process->stats.stateSince = clockTick;
+}
+
+/**
+ * Returns the total ticks a process has spent in the READY or a blocked state,
+ * including the time spent so far if it is currently in that state.
+ */
+static unsigned long TimeInState(PROCESS *process, STATE state) {
+	unsigned long total = state == READY ? process->stats.readyTime : 
+		process->stats.blockedTime[state - BLOCKED_SEM];
+	if (process->state == state) {
+		total += clockTick - process->stats.stateSince;
+	}
+	return total;
+}
+
+/**
+ * Assigns the next PID to a new process and records it in the PID table.
+ * Returns the PID on success, -1 if the table or the runqueue could not be grown.
+ */
+static int RegisterProcess(PROCESS *process) {
+	/* Any CPU's runqueue may end up holding every process, through stealing */
+	for (int i = 0; i < numCpus; i++) {
+		if (RunQueueReserve(&cpus[i].runQueue, numLiveProcesses + 1) < 0) {
+			return -1;
+		}
+	}
+	if (nextAvailPid >= pidTableSize) {
+		int newSize = pidTableSize ? pidTableSize * 2 : PID_TABLE_INIT_SIZE;
+		PROCESS **newTable = (PROCESS **)realloc(pidTable, sizeof(PROCESS *) * newSize);
+		if (newTable == NULL) {
+			return -1;
+		}
+		memset(newTable + pidTableSize, 0, sizeof(PROCESS *) * (newSize - pidTableSize));
+		pidTable = newTable;
+		pidTableSize = newSize;
+	}
+
+	process->pid = nextAvailPid;
+	process->basePriority = process->priority;
+	process->queue = NULL;
+	process->blockedSem = NULL;
+	IListInit(&process->ownedSems);
+	TimerInit(&process->timer, NULL);
+	process->msgsInFlight = 0;
+	process->replyInFlight = 0;
+	process->nextOp = NULL;
+	process->endOp = NULL;
+	process->burstLeft = 0;
+	process->burstSince = clockTick;
+	process->lastSenderPid = -1;
+	process->wokenAt = NOT_WOKEN;
+	process->sentAt = 0;
+	memset(&process->rt, 0, sizeof(process->rt));
+	TimerInit(&process->rt.timer, ReleaseTimerFired);
+	SchedInitEntity(process);
+	process->sched.cpu = LeastLoadedCpu()->id;
+	IListInit(&process->mailbox);
+	IListInit(&process->pendingMsgs);
+	memset(&process->stats, 0, sizeof(process->stats));
+	process->stats.createdAt = clockTick;
+	process->stats.stateSince = clockTick;
+	pidTable[process->pid] = process;
+	nextAvailPid++;
+	numLiveProcesses++;
+	return process->pid;
+}
+
+/**
+ * Removes a process from the PID table and frees it along with any undelivered messages.
+ * The process must already be off the ready and blocked queues. If it was waiting on a
+ * semaphore it is taken off that semaphore's list, and the semaphore no longer counts it.
+ */
+static void DestroyProcess(PROCESS *process) {
+	if (process->blockedSem != NULL) {
+		process->blockedSem->value++;
+		UnblockFromSemaphore(process);
+	}
+	while (IListCount(&process->ownedSems) > 0) {
+		DisownSemaphore(LINK_ITEM(IListFirst(&process->ownedSems), SEMAPHORE, ownerLink));
+	}
+	if (process->state == SLEEPING) {
+		TimerCancel(&timerWheel, &process->timer);
+		numSleeping--;
+	}
+	if (IS_REAL_TIME(process)) {
+		TimerCancel(&timerWheel, &process->rt.timer);
+		numRtTasks--;
+	}
+	if (process->endOp != NULL) {
+		workloadLive--;
+		workloadWaiting -= WAITS_ON_PROCESS(process->state);
+	}
+	pidTable[process->pid] = NULL;
+	numLiveProcesses--;
+	for (LINK *msgLink = IListPop(&process->pendingMsgs); msgLink != NULL; 
+			msgLink = IListPop(&process->pendingMsgs)) {
+		FreeMsg(LINK_ITEM(msgLink, MSG, link));
+	}
+	for (LINK *msgLink = IListPop(&process->mailbox); msgLink != NULL; 
+			msgLink = IListPop(&process->mailbox)) {
+		FreeMsg(LINK_ITEM(msgLink, MSG, link));
+	}
+	free(process);
+}
+
+/* Appends a process to a blocked queue through the link in its PCB */
+static void EnqueueProcess(ILIST *queue, PROCESS *process) {
+	IListAppend(queue, &process->queueLink);
+	process->queue = queue;
+}
+
+/* Takes a process off whichever blocked queue it is on */
+static void DequeueProcess(PROCESS *process) {
+	if (process->queue == NULL) {
+		return;
+	}
+
+	IListRemove(process->queue, &process->queueLink);
+	process->queue = NULL;
+}
+
 /**
- * Searches the priority queues and blocked queues for a PID.
+ * Returns a pointer to the process with the specified PID, if it is found.
+ * Returns NULL if no process was found.
+ */
+static PROCESS *GetProcByPid(int pid) {
+	if (pid < 0 || pid >= nextAvailPid) {
+		return NULL;
+	}
+	return pidTable[pid];
+}
+
+/**
+ * Removes the process with the given PID from its ready, blocked or semaphore queue and deletes it.
  * Returns the PID if found. Returns 0 if not found.
  */
 static int FindProcByPidAndDelete(int pid) {
-	PROCESS *procToFind = (PROCESS *)malloc(sizeof(PROCESS));
-	procToFind->pid = pid;
-
-	PROCESS *foundProc = NULL;
-	ListFirst(highReadyQueue);
-	foundProc = ListSearch(highReadyQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		ListRemove(highReadyQueue);
-		free(foundProc);
-		printf("Successfully killed process with PID %d\n", pid);
-		return pid;
+	PROCESS *foundProc = GetProcByPid(pid);
+	if (foundProc == NULL) {
+		LOG_ERROR("Failed to kill process with PID %d\n", pid);
+		return 0;
 	}
 
-	ListFirst(normalReadyQueue);
-	foundProc = ListSearch(normalReadyQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		ListRemove(normalReadyQueue);
-		free(foundProc);
-		printf("Successfully killed process with PID %d\n", pid);
-		return pid;
+	EMIT_EVENT(EVENT_KILL, pid, foundProc->priority);
+	if (foundProc->state == READY && IS_REAL_TIME(foundProc)) {
+		rtPolicy->remove(&cpus[foundProc->sched.cpu].rtQueue, foundProc);
+	} else if (foundProc->state == READY) {
+		policy->remove(&cpus[foundProc->sched.cpu].runQueue, foundProc);
+	} else {
+		DequeueProcess(foundProc);
 	}
+	DestroyProcess(foundProc);
+	LOG("Successfully killed process with PID %d\n", pid);
+	return pid;
+}
 
-	ListFirst(lowReadyQueue);
-	foundProc = ListSearch(lowReadyQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		ListRemove(lowReadyQueue);
-		free(foundProc);
-		printf("Successfully killed process with PID %d\n", pid);
-		return pid;
+/* Returns the semaphore with the given ID, or NULL if it is out of range or not initialized */
+static SEMAPHORE *GetSemaphore(int id) {
+	if (id < 0 || id >= semaphoreTableSize) {
+		return NULL;
 	}
+	return semaphoreTable[id];
+}
 
-	ListFirst(blockedQueue);
-	foundProc = ListSearch(blockedQueue, PidComparator, procToFind);
-	if (foundProc != NULL) {
-		ListRemove(blockedQueue);
-		free(foundProc);
-		printf("Successfully killed process with PID %d\n", pid);
-		return pid;
+/**
+ * Removes the given process from the send or receive blocked queue it is waiting on.
+ */
+static void RemoveFromBlockedQueue(PROCESS *process) {
+	if (process->queue == &sendBlockedQueue || process->queue == &rcvBlockedQueue) {
+		DequeueProcess(process);
+		LOG("Successfully removed process with PID %d from the blocked queue.\n", process->pid);
+	} else {
+		LOG_ERROR("Failed to remove process with PID %d from the blocked queue.\n", process->pid);
 	}
+}
 
-	free(foundProc);
-	printf("Failed to kill process with PID %d\n", pid);
-	return 0;
+/* Takes a process off the blocked list of the semaphore it is waiting on */
+static void UnblockFromSemaphore(PROCESS *process) {
+	SEMAPHORE *semaphore = process->blockedSem;
+	TimerCancel(&timerWheel, &process->timer);
+	IListRemove(&semaphore->blockedList, &process->semLink);
+	semaphore->waiting[process->basePriority]--;
+	process->blockedSem = NULL;
+	numSemBlocked--;
+	CheckInversion(semaphore);
+	if (semaphore->owner != NULL) {
+		UpdatePriority(semaphore->owner);
+	}
 }
 
 /**
- * Searches the blocked queue for the process given, and removes it from the queue.
+ * Adds a process to the blocked list of a semaphore. Under a priority protocol it goes behind
+ * every process of the same or higher priority, so V wakes the highest priority first and
+ * each priority in FIFO order. Otherwise it goes last.
  */
-static void RemovePidFromBlockedQueue(PROCESS *process) {
-	ListFirst(blockedQueue);
-	PROCESS *foundProc = ListSearch(blockedQueue, PidComparator, process);
-	if (foundProc != NULL) {
-		ListRemove(blockedQueue);
-		printf("Successfully removed process with PID %d from the blocked queue.\n", process->pid);
-	} else {
-		printf("Failed to remove process with PID %d from the blocked queue.\n", process->pid);
+static void InsertWaiter(SEMAPHORE *semaphore, PROCESS *process) {
+	if (semProtocol == SEM_NONE) {
+		IListAppend(&semaphore->blockedList, &process->semLink);
+		return;
+	}
+	LINK *after = semaphore->blockedList.tail;
+	while (after != NULL && LINK_ITEM(after, PROCESS, semLink)->priority > process->priority) {
+		after = after->previous;
 	}
+	IListInsertAfter(&semaphore->blockedList, after, &process->semLink);
 }
 
 /**
- * Searches the blocked queue for the given PID.
- * Returns the process if found, NULL if not found.
+ * Makes a process that got past P on the semaphore its owner, in place of the last owner.
+ * The INIT and idle processes don't own semaphores they take, as their priority can't change.
  */
-static PROCESS *SearchBlockedQueue(int pid) {
-	PROCESS *process = (PROCESS *)malloc(sizeof(process));
-	process->pid = pid;
-	ListFirst(blockedQueue);
-	PROCESS *foundProc = ListSearch(blockedQueue, PidComparator, process);
-	free(process);
-	return foundProc;
+static void TakeSemaphore(SEMAPHORE *semaphore, PROCESS *process) {
+	PROCESS *lastOwner = DisownSemaphore(semaphore);
+	if (lastOwner != NULL) {
+		UpdatePriority(lastOwner);
+	}
+	if (process->priority != INIT) {
+		semaphore->owner = process;
+		IListAppend(&process->ownedSems, &semaphore->ownerLink);
+		UpdatePriority(process);
+	}
+	CheckInversion(semaphore);
+}
+
+/**
+ * Leaves the semaphore without an owner. Returns the owner it had, whose priority may now be
+ * too high, or NULL if it had none.
+ */
+static PROCESS *DisownSemaphore(SEMAPHORE *semaphore) {
+	PROCESS *owner = semaphore->owner;
+	if (owner != NULL) {
+		IListRemove(&owner->ownedSems, &semaphore->ownerLink);
+		semaphore->owner = NULL;
+		CheckInversion(semaphore);
+	}
+	return owner;
+}
+
+/**
+ * Under a priority protocol, schedules a process at the highest of its base priority, the
+ * priorities of the processes waiting on semaphores it owns, and under the ceiling protocol
+ * their ceilings. If the process is itself waiting, the owner of that semaphore is updated in
+ * turn, and so on down the chain, which stops at the first priority that doesn't change.
+ */
+static void UpdatePriority(PROCESS *process) {
+	if (semProtocol == SEM_NONE) {
+		return;
+	}
+	while (process != NULL) {
+		PRIORITY priority = process->basePriority;
+		ILIST_FOR_EACH(link, &process->ownedSems) {
+			SEMAPHORE *semaphore = LINK_ITEM(link, SEMAPHORE, ownerLink);
+			if (semProtocol == SEM_CEILING && semaphore->ceiling < priority) {
+				priority = semaphore->ceiling;
+			}
+			/* The list is in priority order, so the first waiter has the highest */
+			LINK *first = IListFirst(&semaphore->blockedList);
+			if (first != NULL && LINK_ITEM(first, PROCESS, semLink)->priority < priority) {
+				priority = LINK_ITEM(first, PROCESS, semLink)->priority;
+			}
+		}
+		if (priority == process->priority) {
+			return;
+		}
+		SetEffectivePriority(process, priority);
+		process = process->blockedSem != NULL ? process->blockedSem->owner : NULL;
+	}
+}
+
+/**
+ * Schedules a process at a new priority, leaving its base priority as it is. A ready process
+ * moves to the ready queue of its new level, and a blocked one to its new place on the
+ * semaphore's blocked list.
+ */
+static void SetEffectivePriority(PROCESS *process, PRIORITY priority) {
+	LOG("PID %d now runs at %s priority (base %s).\n", process->pid, PRIORITIES[priority], 
+		PRIORITIES[process->basePriority]);
+	int ready = process->state == READY && !IS_REAL_TIME(process);
+	if (ready) {
+		policy->remove(&cpus[process->sched.cpu].runQueue, process);
+	}
+	SchedSetPriority(process, priority);
+	if (ready) {
+		policy->enqueue(&cpus[process->sched.cpu].runQueue, process, clockTick);
+	}
+	if (process->blockedSem != NULL) {
+		IListRemove(&process->blockedSem->blockedList, &process->semLink);
+		InsertWaiter(process->blockedSem, process);
+	}
+}
+
+/**
+ * Starts or ends a priority inversion on the semaphore: a time when a process waits on it while
+ * a process of lower base priority owns it. Each one that ends is recorded under the highest
+ * base priority that waited during it. Only runs on the command thread, so it records into
+ * the command CPU's histograms.
+ */
+static void CheckInversion(SEMAPHORE *semaphore) {
+	int highest = HIGH;
+	while (highest < INIT && semaphore->waiting[highest] == 0) {
+		highest++;
+	}
+	int inverted = semaphore->owner != NULL && highest < (int)semaphore->owner->basePriority;
+
+	if (inverted && semaphore->invertedSince == NOT_INVERTED) {
+		semaphore->invertedSince = clockTick;
+		semaphore->invertedPriority = (PRIORITY)highest;
+	} else if (inverted && highest < (int)semaphore->invertedPriority) {
+		semaphore->invertedPriority = (PRIORITY)highest;
+	} else if (!inverted && semaphore->invertedSince != NOT_INVERTED) {
+		HistRecord(&currentCpu->latency[LATENCY_INVERSION][semaphore->invertedPriority], 
+			clockTick - semaphore->invertedSince);
+		semaphore->invertedSince = NOT_INVERTED;
+	}
+}
+
+/* Returns the number of processes blocked for any reason */
+static int NumBlockedProcesses() {
+	return IListCount(&sendBlockedQueue) + IListCount(&rcvBlockedQueue) + numSemBlocked + numSleeping;
 }
 
 /**
- * Used when a new process starts running.
- * Checks if a new message or reply was received and displays it.
- * Deletes the message after we're done using it.
+ * Used when a process starts running.
+ * Displays every message and reply delivered to its PCB while it wasn't running, oldest first.
+ * Returns each message to the pool after we're done using it.
  */
-static void HandleMsgIfReceived() {
-	if (runningProcess->msg != NULL) {
-		switch(runningProcess->msg->type) {
+static void HandleMsgIfReceived(PROCESS *process) {
+	for (LINK *msgLink = IListPop(&process->pendingMsgs); msgLink != NULL; 
+			msgLink = IListPop(&process->pendingMsgs)) {
+		MSG *msg = LINK_ITEM(msgLink, MSG, link);
+		switch(msg->type) {
 			case NEW:
-				printf("New message received from PID %d.\n", runningProcess->msg->sendPid);
+				LOG("New message received from PID %d.\n", msg->sendPid);
+				process->lastSenderPid = msg->sendPid;
 				break;
 			case REPLY:
-				printf("Reply received from PID %d.\n", runningProcess->msg->sendPid);
+				LOG("Reply received from PID %d.\n", msg->sendPid);
 				break;
 			default:
-				printf("Malformed message received...\n");
-				return;
+				LOG_ERROR("Malformed message received...\n");
+				FreeMsg(msg);
+				continue;
+		}
+
+		LOG("Message body: %s", msg->text);
+		EMIT_EVENT(EVENT_MSG_DEQUEUE, process->pid, msg->sendPid);
+		process->stats.msgsReceived++;
+		FreeMsg(msg);
+	}
+}
+
+/**
+ * Hands a message or reply to its receiver. A new message for a process that isn't waiting
+ * for one goes to its mailbox. Otherwise the message is copied to the receiver's PCB, and the
+ * receiver is woken up if it was waiting for it.
+ */
+static void DeliverMsg(PROCESS *rcvProcess, MSG *msg) {
+	STATE waitingState = msg->type == NEW ? BLOCKED_RCV : BLOCKED_SEND;
+	if (msg->type == NEW && rcvProcess->state != BLOCKED_RCV) {
+		IListAppend(&rcvProcess->mailbox, &msg->link);
+		EMIT_EVENT(EVENT_MSG_ENQUEUE, rcvProcess->pid, msg->sendPid);
+		return;
+	}
+
+	if (msg->type == NEW) {
+		LOG("The destination process was already waiting for a message.\n");
+	}
+	IListAppend(&rcvProcess->pendingMsgs, &msg->link);
+	EMIT_EVENT(EVENT_MSG_ENQUEUE, rcvProcess->pid, msg->sendPid);
+
+	if (rcvProcess->state == waitingState) {
+		LOG("Waking up the receiver process and placing it on the ready queue.\n");
+		SetProcessState(rcvProcess, READY);
+		EMIT_EVENT(EVENT_WAKE, rcvProcess->pid, msg->sendPid);
+		RemoveFromBlockedQueue(rcvProcess);
+		if (msg->type == REPLY) {
+			HistRecord(&cpus[rcvProcess->sched.cpu].latency[LATENCY_ROUND_TRIP][rcvProcess->basePriority],
+				clockTick - rcvProcess->sentAt);
 		}
+		rcvProcess->wokenAt = clockTick;
+		AddProcessToReadyQueue(rcvProcess);
+	}
+}
 
-		printf("Message body: %s", runningProcess->msg->text);
+/**
+ * Delivers the messages of a delivery, in the order they were sent, once their delay has passed.
+ * A message is dropped if its receiver was killed while it was on the way.
+ */
+static void MsgDeliveryFired(TIMER *timer) {
+	DELIVERY *delivery = LINK_ITEM(timer, DELIVERY, timer);
+	clockTick = timer->expires;
+	for (LINK *msgLink = IListPop(&delivery->msgs); msgLink != NULL; msgLink = IListPop(&delivery->msgs)) {
+		MSG *msg = LINK_ITEM(msgLink, MSG, link);
+		PROCESS *rcvProcess = GetProcByPid(msg->rcvPid);
+		if (rcvProcess == NULL) {
+			LOG("A message from PID %d arrived at clock tick %lu, but PID %d no longer exists.\n", 
+				msg->sendPid, clockTick, msg->rcvPid);
+			FreeMsg(msg);
+			continue;
+		}
 
-		free(runningProcess->msg->text);
-		free(runningProcess->msg);
-		runningProcess->msg = NULL;
+		LOG("A %s from PID %d arrived for PID %d at clock tick %lu.\n", msg->type == NEW ? "message" : "reply",
+			msg->sendPid, msg->rcvPid, clockTick);
+		if (msg->type == NEW) {
+			rcvProcess->msgsInFlight--;
+		} else {
+			rcvProcess->replyInFlight = 0;
+		}
+		DeliverMsg(rcvProcess, msg);
+		StepWorkload();
+	}
+	IListPrepend(&deliveryFreeList, &delivery->link);
+}
+
+/**
+ * Puts a message in flight until msgDelay ticks from now, so message slots carry no timer of their
+ * own. It joins the delivery of the last message sent if that arrives on the same tick and no other
+ * timer has been set for that tick since, so everything due on a tick still happens in order.
+ * Returns 0 on success, -1 if out of memory.
+ */
+static int PutInFlight(MSG *msg) {
+	unsigned long arrival = clockTick + msgDelay;
+	if (lastDelivery == NULL || !TimerLastInSlot(&lastDelivery->timer) || lastDelivery->timer.expires != arrival) {
+		LINK *freeLink = IListPop(&deliveryFreeList);
+		DELIVERY *delivery = freeLink != NULL ? LINK_ITEM(freeLink, DELIVERY, link) : 
+			(DELIVERY *)malloc(sizeof(DELIVERY));
+		if (delivery == NULL) {
+			return -1;
+		}
+		TimerInit(&delivery->timer, MsgDeliveryFired);
+		IListInit(&delivery->msgs);
+		TimerAdd(&timerWheel, &delivery->timer, arrival);
+		lastDelivery = delivery;
 	}
-}
\ No newline at end of file
+	IListAppend(&lastDelivery->msgs, &msg->link);
+	return 0;
+}
+
+/**
+ * Checks if a process already has msgQueueCapacity messages queued, counting both its mailbox
+ * and the messages delivered to its PCB. Replies aren't limited by this: a process only gets
+ * one per send, and refusing it would leave the sender blocked for good.
+ */
+static int MsgQueueFull(PROCESS *process) {
+	return IListCount(&process->mailbox) + IListCount(&process->pendingMsgs) + process->msgsInFlight 
+		>= msgQueueCapacity;
+}
+
+/**
+ * Takes a slot from the message pool and fills it in. The text must fit in MAX_MSG_LEN.
+ * Returns NULL if the pool is empty and can't grow.
+ */
+static MSG *NewMsg(MSG_TYPE type, int sendPid, int rcvPid, const char *text) {
+	if (IListCount(&msgFreeList) == 0 && GrowMsgPool() < 0) {
+		return NULL;
+	}
+	MSG *msg = LINK_ITEM(IListPop(&msgFreeList), MSG, link);
+	msg->type = type;
+	msg->sendPid = sendPid;
+	msg->rcvPid = rcvPid;
+	memcpy(msg->text, text, strlen(text) + 1);
+	return msg;
+}
+
+/**
+ * Adds a cache-line-aligned chunk of MSG_CHUNK_SIZE slots to the message pool.
+ * Chunks are never released, so once the pool covers the peak number of messages in flight,
+ * messaging does no heap allocation.
+ * Returns 0 on success, -1 if out of memory.
+ */
+static int GrowMsgPool() {
+	MSG *chunk = (MSG *)aligned_alloc(CACHE_LINE_SIZE, sizeof(MSG) * MSG_CHUNK_SIZE);
+	if (chunk == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < MSG_CHUNK_SIZE; i++) {
+		IListAppend(&msgFreeList, &chunk[i].link);
+	}
+	msgChunks++;
+	return 0;
+}
+
+/**
+ * Returns a message to the pool. The slot is reused first, while it is still in cache.
+ * CPU threads can't touch the pool, so they queue the slot for the command thread instead.
+ */
+static void FreeMsg(MSG *msg) {
+	if (cpuThread != NULL) {
+		MpscPush(&msgReturnQueue, &msg->link);
+	} else {
+		IListPrepend(&msgFreeList, &msg->link);
+	}
+}
+
+/**
+ * Copies the next command line, including its newline, from the input into the input buffer.
+ * Input is read in large blocks, so one read may hold many commands or only part of one.
+ * Lines longer than the input buffer are truncated.
+ * Returns 0 on success, -1 once the input is exhausted.
+ */
+static int ReadCommand() {
+	size_t length = 0;
+	char *newline = NULL;
+
+	while (newline == NULL) {
+		/* Refill the block once every byte in it has been consumed */
+		if (readPos == readLen) {
+			ssize_t bytesRead = read(inputFd, readBlock, READ_BLOCK_SIZE);
+			if (bytesRead <= 0) {
+				break;
+			}
+			readPos = 0;
+			readLen = (size_t)bytesRead;
+		}
+
+		char *start = readBlock + readPos;
+		newline = memchr(start, '\n', readLen - readPos);
+		size_t lineBytes = newline ? (size_t)(newline - start) + 1 : readLen - readPos;
+		size_t copyBytes = lineBytes < BUF_SIZE - 1 - length ? lineBytes : BUF_SIZE - 1 - length;
+		memcpy(inputBuffer + length, start, copyBytes);
+		length += copyBytes;
+		readPos += lineBytes;
+	}
+
+	if (length == 0) {
+		return -1;
+	}
+
+	/* A final line without a newline is treated as if it had one */
+	if (inputBuffer[length - 1] != '\n' && length < BUF_SIZE - 1) {
+		inputBuffer[length++] = '\n';
+	}
+	inputBuffer[length] = '\0';
+	return 0;
+}
+
+/**
+ * Prints one event per line as: <nanoseconds since start> <event> <pid> <arg>
+ */
+static void PrintEvent(const TRACE_RECORD *record) {
+	fprintf(LOG_STREAM, "%llu %s %d %d\n", (unsigned long long)record->timestamp, 
+		EVENT_NAMES[record->type], record->pid, record->arg);
+}
+
+/**
+ * Writes the event trace ring to the file named in the input buffer (trace.bin by default).
+ * The file can be decoded with the tracedump tool.
+ */
+static void DumpTrace() {
+	char *path = inputBuffer + 2;
+	path[strcspn(path, "\r\n")] = '\0';
+	if (inputBuffer[1] != ' ' || *path == '\0') {
+		path = "trace.bin";
+	}
+
+	int numRecords = TraceDump(path);
+	if (numRecords < 0) {
+		LOG_ERROR("Failed to write the event trace to %s.\n", path);
+		return;
+	}
+	LOG("Wrote %d events to %s.\n", numRecords, path);
+}
+
+/**
+ * Prints throughput and peak memory for the whole run to stderr.
+ * Registered with atexit by -S, so it also runs when the INIT process is killed.
+ */
+static void PrintRunStats() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double seconds = (double)(now.tv_sec - runStartTime.tv_sec) 
+		+ (double)(now.tv_nsec - runStartTime.tv_nsec) / 1e9;
+	double rateSeconds = seconds > 0 ? seconds : 1e-9;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	fflush(stdout);
+	fprintf(stderr, "Run statistics (%s policy):\n", policy->name);
+	fprintf(stderr, "  Commands: %ld in %.3f s (%.0f commands/sec)\n", 
+		commandsRun, seconds, commandsRun / rateSeconds);
+	unsigned long totalContextSwitches = TotalContextSwitches();
+	fprintf(stderr, "  Context switches: %lu (%.0f/sec)\n", 
+		totalContextSwitches, totalContextSwitches / rateSeconds);
+	for (int i = 0; i < numCpus && numCpus > 1; i++) {
+		unsigned long ticks = cpus[i].stats.busyTicks + cpus[i].stats.idleTicks;
+		fprintf(stderr, "  CPU %d: %.1f%% busy, %lu switches, %lu steals, %lu stolen from\n", i, 
+			ticks ? 100.0 * cpus[i].stats.busyTicks / ticks : 0.0, cpus[i].stats.contextSwitches, 
+			cpus[i].stats.steals, cpus[i].stats.stolenFrom);
+	}
+	fprintf(stderr, "  Clock ticks: %lu (%.0f/sec), timers fired: %lu\n", 
+		clockTick, clockTick / rateSeconds, timerWheel.fired);
+	if (cpuThreads != NULL) {
+		fprintf(stderr, "  CPU threads: %lu quanta in %lu batches, %lu quanta inline on the command thread\n", 
+			quantaBatched, numBatches, quantaInline);
+	}
+	fprintf(stderr, "  Processes created: %d, still live: %d\n", nextAvailPid, numLiveProcesses);
+	if (workloadPids != NULL) {
+		fprintf(stderr, "  Workload: %u of %u processes arrived, %d still live\n", nextArrival, 
+			workload.numProcs, workloadLive);
+	}
+	fprintf(stderr, "  Message slots: %ld in %ld chunks\n", msgChunks * MSG_CHUNK_SIZE, msgChunks);
+	fprintf(stderr, "  Peak memory: %ld KiB\n", usage.ru_maxrss);
+	HISTOGRAM inversions = {0};
+	for (int cpuIndex = 0; cpuIndex < numCpus; cpuIndex++) {
+		for (int level = 0; level < NUM_RUN_LEVELS; level++) {
+			HistMerge(&inversions, &cpus[cpuIndex].latency[LATENCY_INVERSION][level]);
+		}
+	}
+	fprintf(stderr, "  Priority inversions: %llu, longest %llu ticks (%s semaphore protocol)\n", 
+		(unsigned long long)inversions.total, (unsigned long long)inversions.max, SEM_PROTOCOLS[semProtocol]);
+	if (rtJobsDone > 0 || numRtTasks > 0) {
+		fprintf(stderr, "  Real-time jobs: %lu finished, %lu after their deadline (%s policy)\n", rtJobsDone, 
+			rtMisses, rtPolicy->name);
+	}
+	PrintLatencies(stderr);
+}
@@ -1,7 +1,18 @@
+#ifndef _PROCESS_H_
+#define _PROCESS_H_
+
 /***************************************************************
  * Imports                                                     *
  ***************************************************************/
 #include "list.h"
+#include "timer.h"
+#include "workload.h"
+
+/***************************************************************
+ * Defines and Constants                                       *
+ ***************************************************************/
+#define MAX_MSG_LEN		40
+#define IS_REAL_TIME(process)	((process)->rt.period != 0)
 
 /***************************************************************
  * Structs                                                     *
@@ -18,7 +29,8 @@ typedef enum STATE {
 	READY,
 	BLOCKED_SEM,
 	BLOCKED_SEND,
-	BLOCKED_RCV
+	BLOCKED_RCV,
+	SLEEPING
 } STATE;
 
 typedef enum MSG_TYPE {
@@ -26,21 +38,94 @@ typedef enum MSG_TYPE {
 	REPLY
 } MSG_TYPE;
 
+/**
+ * The owner of a semaphore is the last process to get past P on it that hasn't done a V on it
+ * since. A V that wakes a blocked process hands ownership to it.
+ */
 typedef struct SEMAPHORE {
+	int id;
 	int value;
-	LIST *blockedList;
+	ILIST blockedList;	// Processes blocked on this semaphore, linked through semLink
+	struct PROCESS *owner;	// NULL if none, and for semaphores last taken by the INIT process
+	LINK ownerLink;		// Position in the owner's ownedSems
+	PRIORITY ceiling;	// Priority its owner runs at under the ceiling protocol, INIT for none
+	int waiting[INIT];	// Blocked processes of each base priority
+	unsigned long invertedSince;	// Tick a process started waiting on a lower priority owner
+	PRIORITY invertedPriority;		// Highest base priority that has waited on it since then
 } SEMAPHORE;
 
+/* Fixed-size message slot with the text stored inline. Spans at most two cache lines. */
 typedef struct MSG {
-	char *text;
+	LINK link;		// Position in the receiver's mailbox, its delivery while in flight, or the free list
 	int sendPid;
 	int rcvPid;
 	MSG_TYPE type;
+	char text[MAX_MSG_LEN + 1];
 } MSG;
 
+/* Per-process accounting. Times are in ticks of the logical clock advanced by Quantum. */
+typedef struct PROC_STATS {
+	unsigned long createdAt;		// Tick the process was created at
+	unsigned long stateSince;		// Tick of the last state change
+	unsigned long quantaRun;		// Quanta that expired while the process was running
+	unsigned long readyTime;		// Ticks spent on a ready queue
+	unsigned long blockedTime[4];	// Ticks spent blocked or sleeping, indexed by state - BLOCKED_SEM
+	unsigned long contextSwitches;	// Times the process was switched in to run
+	unsigned long msgsSent;			// Messages and replies sent
+	unsigned long msgsReceived;		// Messages and replies received
+} PROC_STATS;
+
+/**
+ * A periodic real-time task. Every period releases a job that runs for wcet ticks and should
+ * finish by its deadline. A job released while the last one is unfinished starts once it is done.
+ */
+typedef struct RT_TASK {
+	unsigned long period;			// 0 for processes that aren't real-time tasks
+	unsigned long wcet;				// Ticks of CPU each job runs for
+	unsigned long deadline;			// Ticks after its release a job should finish by, at most period
+	unsigned long releasedAt;		// Release tick of the job running, or of the last one finished
+	unsigned long jobsReleased;
+	unsigned long jobsDone;
+	unsigned long misses;			// Jobs that finished after their deadline
+	unsigned long worstResponse;	// Longest time from the release of a job to its finish
+	TIMER timer;					// Releases the next job
+} RT_TASK;
+
+/* Scheduling policy state, see sched.h */
+typedef struct SCHED_ENTITY {
+	int cpu;					// CPU whose runqueue the process is on or will join
+	int level;					// Level of the ready queue the process is on or will join
+	int heapIndex;				// Position in the runqueue heap, -1 if not in it
+	unsigned long long key;		// Stride pass, CFS virtual runtime, or real-time deadline or period
+	unsigned long seq;			// Order the process was enqueued in, for ties between equal keys
+	unsigned long readySince;	// Tick the process joined its current level, for MLFQ aging
+} SCHED_ENTITY;
+
 typedef struct PROCESS {
-	PRIORITY priority;
+	PRIORITY priority;	// Priority the process is scheduled at, raised above basePriority by semaphores it owns
+	PRIORITY basePriority;
 	STATE state;
 	int pid;
-	MSG *msg;
-} PROCESS;
\ No newline at end of file
+	ILIST mailbox;	// Messages sent to the process that it hasn't received yet, oldest first
+	ILIST pendingMsgs;	// Messages delivered to the PCB, shown the next time the process runs
+	ILIST *queue;	// Ready or blocked queue the process is on, NULL if none
+	LINK queueLink;	// Position in that queue
+	LINK semLink;	// Position in a semaphore's blocked list
+	struct SEMAPHORE *blockedSem;	// Semaphore the process is blocked on, NULL if none
+	ILIST ownedSems;	// Semaphores the process owns, linked through ownerLink
+	TIMER timer;	// Ends a sleep, or a P with a timeout
+	int msgsInFlight;	// Messages sent to the process that haven't been delivered yet
+	int replyInFlight;	// 1 if a reply to the process hasn't been delivered yet
+	const WL_OP *nextOp;	// Next workload step, NULL for processes created by commands
+	const WL_OP *endOp;		// End of the process's workload steps
+	unsigned long burstLeft;	// Ticks of the CPU burst at nextOp, or of the real-time job, not run yet
+	unsigned long burstSince;	// Tick burstLeft was last brought up to date
+	int lastSenderPid;	// Sender of the last message received, which a reply step answers
+	unsigned long wokenAt;	// Tick a V or message woke the process at, until it runs
+	unsigned long sentAt;	// Tick of the send the process is waiting on a reply to
+	RT_TASK rt;
+	SCHED_ENTITY sched;
+	PROC_STATS stats;
+} PROCESS;
+
+#endif /* _PROCESS_H_ */
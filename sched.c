@@ -0,0 +1,398 @@
+/***************************************************************
+ * Scheduling policies over a per-CPU runqueue                 *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "sched.h"
+#include <stdlib.h>
+#include <string.h>
+
+/***************************************************************
+ * Defines and Constants                                       *
+ ***************************************************************/
+#define HEAP_INIT_CAPACITY	64
+#define STRIDE1				(1 << 20)	// Pass a process with one ticket advances per quantum
+#define NICE_0_WEIGHT		1024
+#define CFS_QUANTUM_VRUNTIME	1000	// Vruntime charged per quantum at NICE_0_WEIGHT
+#define CFS_SLEEPER_CREDIT	(CFS_QUANTUM_VRUNTIME / 2)	// How far behind the minimum a waking process may start
+
+/* Indexed by priority. Stride tickets are in a 3:2:1 ratio, CFS weights match nice -5, 0 and 5. */
+static const unsigned long long STRIDE_TICKETS[NUM_RUN_LEVELS] = {300, 200, 100};
+static const unsigned long long CFS_WEIGHTS[NUM_RUN_LEVELS] = {3121, 1024, 335};
+
+/***************************************************************
+ * Function Prototypes                                         *
+ ***************************************************************/
+static void levelEnqueue(RUNQUEUE *runQueue, PROCESS *process);
+static void levelRemove(RUNQUEUE *runQueue, PROCESS *process);
+static PROCESS *levelPickNext(RUNQUEUE *runQueue);
+static void rrEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now);
+static void rrQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now);
+static void mlfqEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now);
+static void mlfqQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now);
+
+static int heapLess(PROCESS *a, PROCESS *b);
+static void heapPlace(RUNQUEUE *runQueue, PROCESS *process, int index);
+static void heapSiftUp(RUNQUEUE *runQueue, int index);
+static void heapSiftDown(RUNQUEUE *runQueue, int index);
+static void heapPush(RUNQUEUE *runQueue, PROCESS *process);
+static void heapRemove(RUNQUEUE *runQueue, PROCESS *process);
+static PROCESS *heapPickNext(RUNQUEUE *runQueue);
+static void strideEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now);
+static void strideQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now);
+static void cfsEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now);
+static void cfsQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now);
+static void edfEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now);
+static void rmEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now);
+static void rtQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now);
+static const SCHED_POLICY *findPolicy(const SCHED_POLICY * const *policies, size_t count, const char *name);
+
+/***************************************************************
+ * Policies                                                    *
+ ***************************************************************/
+
+/* Fixed priorities, round robin within each priority */
+static const SCHED_POLICY RR_POLICY =
+	{"rr", NULL, rrEnqueue, levelPickNext, levelRemove, rrQuantum};
+
+/* Multilevel feedback queue: demoted a level per expired quantum, promoted a level after waiting */
+static const SCHED_POLICY MLFQ_POLICY =
+	{"mlfq", NULL, mlfqEnqueue, levelPickNext, levelRemove, mlfqQuantum};
+
+/* Stride scheduling: the lowest pass runs, and each quantum advances pass by 1/tickets */
+static const SCHED_POLICY STRIDE_POLICY =
+	{"stride", "pass", strideEnqueue, heapPickNext, heapRemove, strideQuantum};
+
+/* CFS-like: the lowest virtual runtime runs, and each quantum advances it by 1/weight */
+static const SCHED_POLICY CFS_POLICY =
+	{"cfs", "vruntime", cfsEnqueue, heapPickNext, heapRemove, cfsQuantum};
+
+static const SCHED_POLICY * const POLICIES[] = {&RR_POLICY, &MLFQ_POLICY, &STRIDE_POLICY, &CFS_POLICY};
+
+/* Earliest deadline first: the job with the earliest absolute deadline runs */
+static const SCHED_POLICY EDF_POLICY =
+	{"edf", "deadline", edfEnqueue, heapPickNext, heapRemove, rtQuantum};
+
+/* Rate monotonic: the task with the shortest period runs */
+static const SCHED_POLICY RM_POLICY =
+	{"rm", "period", rmEnqueue, heapPickNext, heapRemove, rtQuantum};
+
+static const SCHED_POLICY * const RT_POLICIES[] = {&EDF_POLICY, &RM_POLICY};
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * Looks up a policy by name (rr, mlfq, stride or cfs).
+ * Returns NULL if there is no policy with that name.
+ */
+const SCHED_POLICY *SchedFindPolicy(const char *name) {
+	return findPolicy(POLICIES, sizeof(POLICIES) / sizeof(POLICIES[0]), name);
+}
+
+/**
+ * Looks up a policy for real-time tasks by name (edf or rm).
+ * Returns NULL if there is no such policy.
+ */
+const SCHED_POLICY *SchedFindRtPolicy(const char *name) {
+	return findPolicy(RT_POLICIES, sizeof(RT_POLICIES) / sizeof(RT_POLICIES[0]), name);
+}
+
+/* Initializes an empty runqueue */
+void RunQueueInit(RUNQUEUE *runQueue) {
+	memset(runQueue, 0, sizeof(*runQueue));
+	for (int level = 0; level < NUM_RUN_LEVELS; level++) {
+		IListInit(&runQueue->levels[level]);
+	}
+}
+
+/**
+ * Makes sure the heap can hold capacity processes, so enqueueing never has to allocate.
+ * Returns 0 on success, -1 if out of memory.
+ */
+int RunQueueReserve(RUNQUEUE *runQueue, int capacity) {
+	if (capacity <= runQueue->heapCapacity) {
+		return 0;
+	}
+	int newCapacity = runQueue->heapCapacity ? runQueue->heapCapacity : HEAP_INIT_CAPACITY;
+	while (newCapacity < capacity) {
+		newCapacity *= 2;
+	}
+	PROCESS **newHeap = (PROCESS **)realloc(runQueue->heap, sizeof(PROCESS *) * newCapacity);
+	if (newHeap == NULL) {
+		return -1;
+	}
+	runQueue->heap = newHeap;
+	runQueue->heapCapacity = newCapacity;
+	return 0;
+}
+
+/* Resets the scheduling state of a new process. It starts on the level of its priority. */
+void SchedInitEntity(PROCESS *process) {
+	process->sched.cpu = 0;
+	process->sched.level = process->priority;
+	process->sched.heapIndex = -1;
+	process->sched.key = 0;
+	process->sched.seq = 0;
+	process->sched.readySince = 0;
+}
+
+/**
+ * Changes the priority a process is scheduled at. Its level follows, so a raised process is never
+ * below the level of its new priority and a lowered one never above it. MLFQ keeps any level the
+ * process earned in between. The process must not be on a runqueue.
+ */
+void SchedSetPriority(PROCESS *process, PRIORITY priority) {
+	if (priority < process->priority && process->sched.level > (int)priority) {
+		process->sched.level = priority;
+	} else if (priority > process->priority && process->sched.level < (int)priority) {
+		process->sched.level = priority;
+	}
+	process->priority = priority;
+}
+
+/**
+ * Moves a process that was taken off one runqueue over to another, before it runs there.
+ * Its heap key keeps the same distance from the minimum, so it is neither favoured nor
+ * penalised by the other runqueue's pass or vruntime being further along.
+ */
+void SchedMigrate(PROCESS *process, RUNQUEUE *from, RUNQUEUE *to) {
+	long long offset = (long long)(process->sched.key - from->minKey);
+	process->sched.key = offset < 0 && (unsigned long long)-offset > to->minKey ? 0 : to->minKey + offset;
+}
+
+/***************************************************************
+ * Level Queues (RR and MLFQ)                                  *
+ ***************************************************************/
+
+/* Appends a process to the FIFO of its level */
+static void levelEnqueue(RUNQUEUE *runQueue, PROCESS *process) {
+	int level = process->sched.level;
+	IListAppend(&runQueue->levels[level], &process->queueLink);
+	process->queue = &runQueue->levels[level];
+	runQueue->levelBitmap[level / BITMAP_WORD_BITS] |= 1ULL << (level % BITMAP_WORD_BITS);
+	runQueue->count++;
+}
+
+/* Takes a process off its level, clearing the level's bit once it drains */
+static void levelRemove(RUNQUEUE *runQueue, PROCESS *process) {
+	int level = process->sched.level;
+	IListRemove(&runQueue->levels[level], &process->queueLink);
+	process->queue = NULL;
+	if (IListCount(&runQueue->levels[level]) == 0) {
+		runQueue->levelBitmap[level / BITMAP_WORD_BITS] &= ~(1ULL << (level % BITMAP_WORD_BITS));
+	}
+	runQueue->count--;
+}
+
+/* Takes the first process from the highest non-empty level, found a bitmap word at a time */
+static PROCESS *levelPickNext(RUNQUEUE *runQueue) {
+	int word = 0;
+	while (word < LEVEL_BITMAP_WORDS && runQueue->levelBitmap[word] == 0) {
+		word++;
+	}
+	if (word == LEVEL_BITMAP_WORDS) {
+		return NULL;
+	}
+	int level = word * BITMAP_WORD_BITS + __builtin_ctzll(runQueue->levelBitmap[word]);
+	PROCESS *process = LINK_ITEM(IListFirst(&runQueue->levels[level]), PROCESS, queueLink);
+	levelRemove(runQueue, process);
+	return process;
+}
+
+static void rrEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now) {
+	(void)now;
+	levelEnqueue(runQueue, process);
+}
+
+static void rrQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now) {
+	(void)runQueue;
+	(void)preempted;
+	(void)now;
+}
+
+static void mlfqEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now) {
+	process->sched.readySince = now;
+	levelEnqueue(runQueue, process);
+}
+
+/**
+ * Demotes the pre-empted process a level for using its whole quantum, then ages the queues:
+ * a process that has waited MLFQ_AGING_TICKS on a level moves up one. Each level is in
+ * readySince order, so only the processes that are promoted, plus one per level, are looked at.
+ */
+static void mlfqQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now) {
+	if (preempted != NULL && preempted->sched.level < NUM_RUN_LEVELS - 1) {
+		preempted->sched.level++;
+	}
+
+	for (int level = 1; level < NUM_RUN_LEVELS; level++) {
+		while (IListCount(&runQueue->levels[level]) > 0) {
+			PROCESS *oldest = LINK_ITEM(IListFirst(&runQueue->levels[level]), PROCESS, queueLink);
+			if (now - oldest->sched.readySince < MLFQ_AGING_TICKS) {
+				break;
+			}
+			levelRemove(runQueue, oldest);
+			oldest->sched.level = level - 1;
+			mlfqEnqueue(runQueue, oldest, now);
+		}
+	}
+}
+
+/***************************************************************
+ * Min-heap (stride and CFS)                                   *
+ ***************************************************************/
+
+/* Orders by key, then by enqueue order so equal keys are served FIFO */
+static int heapLess(PROCESS *a, PROCESS *b) {
+	if (a->sched.key != b->sched.key) {
+		return a->sched.key < b->sched.key;
+	}
+	return a->sched.seq < b->sched.seq;
+}
+
+static void heapPlace(RUNQUEUE *runQueue, PROCESS *process, int index) {
+	runQueue->heap[index] = process;
+	process->sched.heapIndex = index;
+}
+
+static void heapSiftUp(RUNQUEUE *runQueue, int index) {
+	PROCESS *process = runQueue->heap[index];
+	while (index > 0) {
+		int parent = (index - 1) / 2;
+		if (!heapLess(process, runQueue->heap[parent])) {
+			break;
+		}
+		heapPlace(runQueue, runQueue->heap[parent], index);
+		index = parent;
+	}
+	heapPlace(runQueue, process, index);
+}
+
+static void heapSiftDown(RUNQUEUE *runQueue, int index) {
+	PROCESS *process = runQueue->heap[index];
+	while (1) {
+		int child = 2 * index + 1;
+		if (child >= runQueue->count) {
+			break;
+		}
+		if (child + 1 < runQueue->count && heapLess(runQueue->heap[child + 1], runQueue->heap[child])) {
+			child++;
+		}
+		if (!heapLess(runQueue->heap[child], process)) {
+			break;
+		}
+		heapPlace(runQueue, runQueue->heap[child], index);
+		index = child;
+	}
+	heapPlace(runQueue, process, index);
+}
+
+/* Adds a process to the heap. RunQueueReserve must have made room for it. */
+static void heapPush(RUNQUEUE *runQueue, PROCESS *process) {
+	process->sched.seq = runQueue->enqueueSeq++;
+	heapPlace(runQueue, process, runQueue->count++);
+	heapSiftUp(runQueue, runQueue->count - 1);
+}
+
+/* Takes a process out of the heap by moving the last process into its slot */
+static void heapRemove(RUNQUEUE *runQueue, PROCESS *process) {
+	int index = process->sched.heapIndex;
+	PROCESS *last = runQueue->heap[--runQueue->count];
+	process->sched.heapIndex = -1;
+	if (last != process) {
+		heapPlace(runQueue, last, index);
+		heapSiftUp(runQueue, index);
+		heapSiftDown(runQueue, last->sched.heapIndex);
+	}
+}
+
+/* Takes the process with the lowest key, advancing minKey to it */
+static PROCESS *heapPickNext(RUNQUEUE *runQueue) {
+	if (runQueue->count == 0) {
+		return NULL;
+	}
+	PROCESS *process = runQueue->heap[0];
+	heapRemove(runQueue, process);
+	if (process->sched.key > runQueue->minKey) {
+		runQueue->minKey = process->sched.key;
+	}
+	return process;
+}
+
+/* A new or waking process joins at the global pass, so time spent blocked isn't banked */
+static void strideEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now) {
+	(void)now;
+	if (process->sched.key < runQueue->minKey) {
+		process->sched.key = runQueue->minKey;
+	}
+	heapPush(runQueue, process);
+}
+
+static void strideQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now) {
+	(void)runQueue;
+	(void)now;
+	if (preempted != NULL) {
+		preempted->sched.key += STRIDE1 / STRIDE_TICKETS[preempted->priority];
+	}
+}
+
+/* A new or waking process starts slightly behind the minimum vruntime, so it runs soon */
+static void cfsEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now) {
+	(void)now;
+	unsigned long long floor = runQueue->minKey > CFS_SLEEPER_CREDIT ?
+		runQueue->minKey - CFS_SLEEPER_CREDIT : 0;
+	if (process->sched.key < floor) {
+		process->sched.key = floor;
+	}
+	heapPush(runQueue, process);
+}
+
+static void cfsQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now) {
+	(void)runQueue;
+	(void)now;
+	if (preempted != NULL) {
+		preempted->sched.key += CFS_QUANTUM_VRUNTIME * NICE_0_WEIGHT / CFS_WEIGHTS[preempted->priority];
+	}
+}
+
+/***************************************************************
+ * Real-time Tasks (EDF and RM)                                *
+ ***************************************************************/
+
+/* Keys the task on the absolute deadline of its current job */
+static void edfEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now) {
+	(void)now;
+	process->sched.key = process->rt.releasedAt + process->rt.deadline;
+	heapPush(runQueue, process);
+}
+
+/* Keys the task on its period, a fixed priority */
+static void rmEnqueue(RUNQUEUE *runQueue, PROCESS *process, unsigned long now) {
+	(void)now;
+	process->sched.key = process->rt.period;
+	heapPush(runQueue, process);
+}
+
+/* Jobs aren't charged for quanta. A job runs until it finishes or an earlier one is ready. */
+static void rtQuantum(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now) {
+	(void)runQueue;
+	(void)preempted;
+	(void)now;
+}
+
+/***************************************************************
+ * Static Functions                                            *
+ ***************************************************************/
+
+static const SCHED_POLICY *findPolicy(const SCHED_POLICY * const *policies, size_t count, const char *name) {
+	for (size_t i = 0; i < count; i++) {
+		if (strcmp(policies[i]->name, name) == 0) {
+			return policies[i];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,94 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "process.h"
+#include "hist.h"
+
+/***************************************************************
+ * Defines                                                     *
+ ***************************************************************/
+#define NUM_RUN_LEVELS		INIT	// One level per priority above INIT
+#define MLFQ_AGING_TICKS	8		// Ticks a process waits on an MLFQ level before it is promoted
+#define MAX_CPUS			64
+#define BITMAP_WORD_BITS	64
+#define LEVEL_BITMAP_WORDS	((NUM_RUN_LEVELS + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/**
+ * Ready processes of one CPU, excluding the INIT process.
+ * RR and MLFQ keep a FIFO per level; stride and CFS keep a min-heap keyed on pass or vruntime.
+ * Real-time tasks have a runqueue of their own, a min-heap keyed on deadline (EDF) or period (RM).
+ */
+typedef struct RUNQUEUE {
+	ILIST levels[NUM_RUN_LEVELS];		// Linked through queueLink
+	unsigned long long levelBitmap[LEVEL_BITMAP_WORDS];	// Bit set for each non-empty level
+	PROCESS **heap;
+	int heapCapacity;
+	int count;							// Ready processes, whatever the policy
+	unsigned long long minKey;			// Stride: global pass. CFS: minimum vruntime.
+	unsigned long enqueueSeq;			// Breaks ties between equal heap keys in FIFO order
+} RUNQUEUE;
+
+/**
+ * A scheduling policy. Only ready processes are on a runqueue: the running process is taken
+ * off by pickNext and put back by enqueue when it is pre-empted or wakes up.
+ */
+typedef struct SCHED_POLICY {
+	const char *name;
+	const char *keyName;	// Name of the heap key, NULL for policies that use levels
+	void (*enqueue)(RUNQUEUE *runQueue, PROCESS *process, unsigned long now);
+	PROCESS *(*pickNext)(RUNQUEUE *runQueue);	// Removes and returns the next process, or NULL
+	void (*remove)(RUNQUEUE *runQueue, PROCESS *process);
+	/* Called when a quantum expires, before the pre-empted process (NULL for INIT) is re-enqueued */
+	void (*quantum)(RUNQUEUE *runQueue, PROCESS *preempted, unsigned long now);
+} SCHED_POLICY;
+
+/* Per-CPU counters for load balancing */
+typedef struct CPU_STATS {
+	unsigned long busyTicks;		// Quanta that expired while a process other than the idle one ran
+	unsigned long idleTicks;		// Quanta that expired while the idle process ran
+	unsigned long contextSwitches;	// Times a different process was switched in to run
+	unsigned long steals;			// Processes this CPU took from another CPU's runqueue
+	unsigned long stolenFrom;		// Processes other CPUs took from this CPU's runqueue
+} CPU_STATS;
+
+/* Latencies recorded per priority, in clock ticks */
+typedef enum LATENCY_KIND {
+	LATENCY_READY,		// From joining a ready queue to running
+	LATENCY_WAKEUP,		// From being woken by a V or a message delivery to running
+	LATENCY_ROUND_TRIP,	// From a send to the delivery of its reply
+	LATENCY_INVERSION,	// Time a semaphore is waited on by a process of higher priority than its owner
+	NUM_LATENCY_KINDS
+} LATENCY_KIND;
+
+/* A simulated CPU. It runs its idle process when it has nothing else to run and can't steal. */
+typedef struct CPU {
+	int id;
+	RUNQUEUE runQueue;
+	RUNQUEUE rtQueue;	// Ready real-time tasks, which run before anything on runQueue
+	PROCESS *running;	// Never NULL, the idle process at worst
+	PROCESS *idle;		// The INIT process on CPU 0
+	CPU_STATS stats;
+	TIMER burstTimer;	// Ends the CPU burst of a running workload process
+	HISTOGRAM latency[NUM_LATENCY_KINDS][NUM_RUN_LEVELS];	// Of the processes on this CPU, merged for reports
+	HISTOGRAM rtResponse;	// From the release of a real-time job to its finish
+} CPU;
+
+/***************************************************************
+ * Function prototypes                                         *
+ ***************************************************************/
+const SCHED_POLICY *SchedFindPolicy(const char *name);
+const SCHED_POLICY *SchedFindRtPolicy(const char *name);
+void RunQueueInit(RUNQUEUE *runQueue);
+int RunQueueReserve(RUNQUEUE *runQueue, int capacity);
+void SchedInitEntity(PROCESS *process);
+void SchedSetPriority(PROCESS *process, PRIORITY priority);
+void SchedMigrate(PROCESS *process, RUNQUEUE *from, RUNQUEUE *to);
+
+#endif /* _SCHED_H_ */
@@ -0,0 +1,227 @@
+/***************************************************************
+ * Hierarchical timing wheel for the discrete-event engine     *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "timer.h"
+#include <limits.h>
+
+/***************************************************************
+ * Defines                                                     *
+ ***************************************************************/
+#define LEVEL_SHIFT(level)	(TIMER_WHEEL_BITS * (level))
+#define SLOT_MASK			(TIMER_WHEEL_SIZE - 1)
+#define WHEEL_SPAN			(1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS))	// Ticks the levels cover
+
+/***************************************************************
+ * Statics                                                     *
+ ***************************************************************/
+static void placeTimer(TIMER_WHEEL *wheel, TIMER *timer);
+static void cascadeSlot(TIMER_WHEEL *wheel, int level, int index);
+static unsigned long nextEventTick(TIMER_WHEEL *wheel);
+static unsigned long long rotateRight(unsigned long long bits, int count);
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * Initialises an empty wheel whose clock reads now.
+ */
+void TimerWheelInit(TIMER_WHEEL *wheel, unsigned long now) {
+	wheel->now = now;
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		for (int index = 0; index < TIMER_WHEEL_SIZE; index++) {
+			IListInit(&wheel->slots[level][index]);
+		}
+		wheel->occupied[level] = 0;
+	}
+	wheel->count = 0;
+	wheel->fired = 0;
+}
+
+/**
+ * Initialises a timer that isn't pending. fire is called when it expires, and may add timers.
+ */
+void TimerInit(TIMER *timer, void (*fire)(TIMER *timer)) {
+	timer->slot = NULL;
+	timer->expires = 0;
+	timer->fire = fire;
+}
+
+/**
+ * Sets the timer to fire at the expires tick, replacing any expiry it already had.
+ * A timer set for the current tick or earlier fires on the next one.
+ */
+void TimerAdd(TIMER_WHEEL *wheel, TIMER *timer, unsigned long expires) {
+	if (timer->slot != NULL) {
+		TimerCancel(wheel, timer);
+	}
+	timer->expires = expires > wheel->now ? expires : wheel->now + 1;
+	placeTimer(wheel, timer);
+	wheel->count++;
+}
+
+/**
+ * Stops the timer if it is pending.
+ */
+void TimerCancel(TIMER_WHEEL *wheel, TIMER *timer) {
+	if (timer->slot == NULL) {
+		return;
+	}
+
+	IListRemove(timer->slot, &timer->link);
+	if (IListCount(timer->slot) == 0) {
+		int slotIndex = (int)(timer->slot - &wheel->slots[0][0]);
+		wheel->occupied[slotIndex / TIMER_WHEEL_SIZE] &= ~(1ULL << (slotIndex % TIMER_WHEEL_SIZE));
+	}
+	timer->slot = NULL;
+	wheel->count--;
+}
+
+/**
+ * Returns 1 if the timer is waiting to fire, 0 otherwise.
+ */
+int TimerPending(TIMER *timer) {
+	return timer->slot != NULL;
+}
+
+/**
+ * Returns 1 if the timer is pending and no timer has joined its slot since, so that nothing
+ * added for the same tick would fire between it and a timer added now. 0 otherwise.
+ */
+int TimerLastInSlot(TIMER *timer) {
+	return timer->slot != NULL && timer->slot->tail == &timer->link;
+}
+
+/**
+ * Moves the clock forward to until, firing every timer that expires on the way in expiry order.
+ * The wheel's clock reads each timer's expiry tick while it fires. Stretches with no timers
+ * due are jumped over rather than stepped through.
+ */
+void TimerAdvance(TIMER_WHEEL *wheel, unsigned long until) {
+	while (wheel->now < until) {
+		unsigned long next = nextEventTick(wheel);
+		if (next > until) {
+			wheel->now = until;
+			break;
+		}
+		wheel->now = next;
+
+		/* Move down the higher level slots that start at this tick */
+		for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+			if (next & ((1ULL << LEVEL_SHIFT(level)) - 1)) {
+				break;
+			}
+			cascadeSlot(wheel, level, (int)((next >> LEVEL_SHIFT(level)) & SLOT_MASK));
+		}
+
+		/* Timers fired here can't join this slot, as a new timer always expires after now */
+		int index = (int)(next & SLOT_MASK);
+		ILIST *slot = &wheel->slots[0][index];
+		for (LINK *link = IListPop(slot); link != NULL; link = IListPop(slot)) {
+			TIMER *timer = LINK_ITEM(link, TIMER, link);
+			timer->slot = NULL;
+			wheel->count--;
+			wheel->fired++;
+			timer->fire(timer);
+		}
+		wheel->occupied[0] &= ~(1ULL << index);
+	}
+}
+
+/**
+ * Returns the first tick after the wheel's clock at which advancing it does anything,
+ * or ULONG_MAX if no timers are pending.
+ */
+unsigned long TimerNextTick(TIMER_WHEEL *wheel) {
+	return nextEventTick(wheel);
+}
+
+/**
+ * As TimerNextTick, but as if the given pending timer were cancelled. The timer keeps its place
+ * in its slot, so timers expiring on the same tick still fire in the order they were added.
+ */
+unsigned long TimerNextTickWithout(TIMER_WHEEL *wheel, TIMER *timer) {
+	if (timer->slot == NULL || IListCount(timer->slot) > 1) {
+		return nextEventTick(wheel);
+	}
+	int slotIndex = (int)(timer->slot - &wheel->slots[0][0]);
+	unsigned long long bit = 1ULL << (slotIndex % TIMER_WHEEL_SIZE);
+	wheel->occupied[slotIndex / TIMER_WHEEL_SIZE] &= ~bit;
+	unsigned long next = nextEventTick(wheel);
+	wheel->occupied[slotIndex / TIMER_WHEEL_SIZE] |= bit;
+	return next;
+}
+
+/***************************************************************
+ * Static Functions                                            *
+ ***************************************************************/
+
+/**
+ * Puts a timer in the slot for its expiry relative to the wheel's clock.
+ * A timer expiring now goes in the level 0 slot for this tick, which only happens while cascading.
+ */
+static void placeTimer(TIMER_WHEEL *wheel, TIMER *timer) {
+	unsigned long long delta = timer->expires - wheel->now;
+	unsigned long long when = timer->expires;
+	int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << LEVEL_SHIFT(level + 1))) {
+		level++;
+	}
+
+	/* Beyond the last level, wait in its furthest slot and be placed again from there */
+	if (delta >= WHEEL_SPAN) {
+		when = wheel->now + WHEEL_SPAN - 1;
+	}
+
+	int index = (int)((when >> LEVEL_SHIFT(level)) & SLOT_MASK);
+	timer->slot = &wheel->slots[level][index];
+	IListAppend(timer->slot, &timer->link);
+	wheel->occupied[level] |= 1ULL << index;
+}
+
+/**
+ * Places every timer of a higher level slot again, now that the wheel has reached it.
+ * They all expire within the slot's span, so each moves to a lower level.
+ */
+static void cascadeSlot(TIMER_WHEEL *wheel, int level, int index) {
+	ILIST *slot = &wheel->slots[level][index];
+	ILIST cascading = *slot;
+	IListInit(slot);
+	wheel->occupied[level] &= ~(1ULL << index);
+
+	for (LINK *link = IListPop(&cascading); link != NULL; link = IListPop(&cascading)) {
+		placeTimer(wheel, LINK_ITEM(link, TIMER, link));
+	}
+}
+
+/**
+ * Returns the first tick after now at which a level 0 slot has timers to fire, or a higher level
+ * slot with timers is cascaded. Nothing happens at the ticks in between. ULONG_MAX if no timers.
+ */
+static unsigned long nextEventTick(TIMER_WHEEL *wheel) {
+	unsigned long next = ULONG_MAX;
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		if (wheel->occupied[level] == 0) {
+			continue;
+		}
+
+		/* Slots are reached in index order from the one after the current position, wrapping */
+		unsigned long base = wheel->now >> LEVEL_SHIFT(level);
+		int position = (int)(base & SLOT_MASK);
+		unsigned long long ahead = rotateRight(wheel->occupied[level], (position + 1) & SLOT_MASK);
+		unsigned long distance = (unsigned long)__builtin_ctzll(ahead) + 1;
+		unsigned long tick = (base + distance) << LEVEL_SHIFT(level);
+		if (tick < next) {
+			next = tick;
+		}
+	}
+	return next;
+}
+
+static unsigned long long rotateRight(unsigned long long bits, int count) {
+	return count ? (bits >> count) | (bits << (TIMER_WHEEL_SIZE - count)) : bits;
+}
@@ -0,0 +1,55 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "list.h"
+
+/***************************************************************
+ * Defines                                                     *
+ ***************************************************************/
+#define TIMER_WHEEL_BITS	6
+#define TIMER_WHEEL_SIZE	(1 << TIMER_WHEEL_BITS)	// Slots per level
+#define TIMER_WHEEL_LEVELS	6	// Levels cover 64^6 ticks; later timers wait in the last level
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/* A timer, embedded in whatever it times like a LINK */
+typedef struct TIMER {
+	LINK link;			// Position in a wheel slot
+	ILIST *slot;		// Slot the timer is in, NULL if it isn't pending
+	unsigned long expires;	// Tick the timer fires at
+	void (*fire)(struct TIMER *timer);
+} TIMER;
+
+/**
+ * Hierarchical timing wheel. Level 0 has a slot per tick for the next 64 ticks, and each level
+ * above has a slot per 64 slots of the level below. A higher level slot is moved down when the
+ * wheel reaches it, so adding and cancelling a timer take constant time, and advancing over ticks
+ * with no timers due is skipped using the bitmaps of occupied slots.
+ */
+typedef struct TIMER_WHEEL {
+	unsigned long now;
+	ILIST slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+	unsigned long long occupied[TIMER_WHEEL_LEVELS];	// Bit set for each non-empty slot
+	int count;		// Pending timers
+	unsigned long fired;	// Timers fired so far
+} TIMER_WHEEL;
+
+/***************************************************************
+ * Function prototypes                                         *
+ ***************************************************************/
+void TimerWheelInit(TIMER_WHEEL *wheel, unsigned long now);
+void TimerInit(TIMER *timer, void (*fire)(TIMER *timer));
+void TimerAdd(TIMER_WHEEL *wheel, TIMER *timer, unsigned long expires);
+void TimerCancel(TIMER_WHEEL *wheel, TIMER *timer);
+int TimerPending(TIMER *timer);
+int TimerLastInSlot(TIMER *timer);
+void TimerAdvance(TIMER_WHEEL *wheel, unsigned long until);
+unsigned long TimerNextTick(TIMER_WHEEL *wheel);
+unsigned long TimerNextTickWithout(TIMER_WHEEL *wheel, TIMER *timer);
+
+#endif /* _TIMER_H_ */
@@ -0,0 +1,95 @@
+/***************************************************************
+ * In-memory ring buffer of scheduler events                   *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+/***************************************************************
+ * Statics                                                     *
+ ***************************************************************/
+static TRACE_RECORD traceRing[TRACE_RING_SIZE];
+static _Atomic uint64_t totalEvents = 0;	// Next slot is totalEvents % TRACE_RING_SIZE
+static struct timespec startTime;
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * Starts the trace clock. Timestamps are measured from this call.
+ */
+void TraceInit(void) {
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	totalEvents = 0;
+}
+
+/**
+ * Records an event in the ring, overwriting the oldest one once the ring is full.
+ * CPU threads can record at the same time, as each claims its own slot. Between them they can
+ * wrap the ring while a slot is being written, so its fields are stored atomically; a slot
+ * claimed twice over at once may then hold fields from both events, which only ever happens
+ * to events old enough to be overwritten anyway.
+ * Returns a copy of the record, as the slot may be reused as soon as it is written.
+ */
+TRACE_RECORD TraceRecord(EVENT_TYPE type, int pid, int arg) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	TRACE_RECORD record;
+	record.timestamp = (uint64_t)(now.tv_sec - startTime.tv_sec) * 1000000000ULL
+		+ (uint64_t)(now.tv_nsec - startTime.tv_nsec);
+	record.pid = pid;
+	record.arg = arg;
+	record.type = type;
+	record.reserved = 0;
+
+	uint64_t slot = atomic_fetch_add_explicit(&totalEvents, 1, memory_order_relaxed);
+	TRACE_RECORD *stored = &traceRing[slot & (TRACE_RING_SIZE - 1)];
+	__atomic_store_n(&stored->timestamp, record.timestamp, __ATOMIC_RELAXED);
+	__atomic_store_n(&stored->pid, record.pid, __ATOMIC_RELAXED);
+	__atomic_store_n(&stored->arg, record.arg, __ATOMIC_RELAXED);
+	__atomic_store_n(&stored->type, record.type, __ATOMIC_RELAXED);
+	__atomic_store_n(&stored->reserved, record.reserved, __ATOMIC_RELAXED);
+	return record;
+}
+
+/**
+ * Writes the events currently held in the ring to a binary file, oldest first.
+ * Returns the number of records written, or -1 on failure.
+ */
+int TraceDump(const char *path) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return -1;
+	}
+
+	uint64_t numRecords = totalEvents < TRACE_RING_SIZE ? totalEvents : TRACE_RING_SIZE;
+	uint64_t first = totalEvents - numRecords;
+
+	TRACE_FILE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(TRACE_RECORD);
+	header.numRecords = numRecords;
+	header.totalEvents = totalEvents;
+
+	/* The oldest records may wrap around the end of the ring, so write in up to two pieces */
+	size_t start = first & (TRACE_RING_SIZE - 1);
+	size_t firstPiece = numRecords < TRACE_RING_SIZE - start ? numRecords : TRACE_RING_SIZE - start;
+	int failed = fwrite(&header, sizeof(header), 1, file) != 1
+		|| fwrite(&traceRing[start], sizeof(TRACE_RECORD), firstPiece, file) != firstPiece
+		|| fwrite(traceRing, sizeof(TRACE_RECORD), numRecords - firstPiece, file) != numRecords - firstPiece;
+
+	if (fclose(file) != 0 || failed) {
+		return -1;
+	}
+	return (int)numRecords;
+}
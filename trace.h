@@ -0,0 +1,46 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "event.h"
+#include <stdint.h>
+
+/***************************************************************
+ * Defines                                                     *
+ ***************************************************************/
+#define TRACE_RING_SIZE		(1 << 16)	// Must be a power of two
+#define TRACE_MAGIC			"SCHEDTRC"
+#define TRACE_VERSION		1
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/* One scheduler event as stored in the ring and in dump files */
+typedef struct TRACE_RECORD {
+	uint64_t timestamp;	// Nanoseconds since TraceInit
+	int32_t pid;
+	int32_t arg;		// Meaning depends on the event type, see event.h
+	uint32_t type;		// EVENT_TYPE
+	uint32_t reserved;
+} TRACE_RECORD;
+
+/* Header at the start of a dump file, followed by numRecords records oldest first */
+typedef struct TRACE_FILE_HEADER {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t numRecords;
+	uint64_t totalEvents;	// Events recorded since start, including ones overwritten in the ring
+} TRACE_FILE_HEADER;
+
+/***************************************************************
+ * Function prototypes                                         *
+ ***************************************************************/
+void TraceInit(void);
+TRACE_RECORD TraceRecord(EVENT_TYPE type, int pid, int arg);
+int TraceDump(const char *path);
+
+#endif /* _TRACE_H_ */
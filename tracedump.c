@@ -0,0 +1,61 @@
+/***************************************************************
+ * Decoder for binary scheduler trace dumps                    *
+ * Usage: tracedump trace_file                                 *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * Prints each record in the same format as the -e event output:
+ * [nanoseconds since start] [event] [pid] [arg]
+ */
+int main(int argc, char *argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s trace_file\n", argv[0]);
+		return 1;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	TRACE_FILE_HEADER header;
+	if (fread(&header, sizeof(header), 1, file) != 1
+			|| memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "%s is not a scheduler trace.\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+	if (header.version != TRACE_VERSION || header.recordSize != sizeof(TRACE_RECORD)) {
+		fprintf(stderr, "Unsupported trace version %" PRIu32 ".\n", header.version);
+		fclose(file);
+		return 1;
+	}
+
+	printf("# %" PRIu64 " of %" PRIu64 " events\n", header.numRecords, header.totalEvents);
+	TRACE_RECORD record;
+	for (uint64_t i = 0; i < header.numRecords; i++) {
+		if (fread(&record, sizeof(record), 1, file) != 1) {
+			fprintf(stderr, "Trace is truncated after %" PRIu64 " records.\n", i);
+			fclose(file);
+			return 1;
+		}
+		const char *name = record.type < NUM_EVENT_TYPES ? EVENT_NAMES[record.type] : "UNKNOWN";
+		printf("%" PRIu64 " %s %" PRId32 " %" PRId32 "\n", record.timestamp, name, record.pid, record.arg);
+	}
+
+	fclose(file);
+	return 0;
+}
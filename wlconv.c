@@ -0,0 +1,59 @@
+/***************************************************************
+ * Converts workload files between text and binary form        *
+ * Usage: wlconv [-t] input output                             *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "workload.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * Reads a workload in either form and writes it in binary form, or in text form with -t.
+ * An output of - writes to stdout.
+ */
+int main(int argc, char *argv[]) {
+	int textOutput = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "t")) != -1) {
+		if (opt != 't') {
+			fprintf(stderr, "Usage: %s [-t] input output\n", argv[0]);
+			return 1;
+		}
+		textOutput = 1;
+	}
+	if (argc - optind != 2) {
+		fprintf(stderr, "Usage: %s [-t] input output\n", argv[0]);
+		return 1;
+	}
+
+	WORKLOAD workload;
+	if (WorkloadLoad(&workload, argv[optind]) < 0) {
+		return 1;
+	}
+
+	const char *outPath = argv[optind + 1];
+	FILE *out = strcmp(outPath, "-") == 0 ? stdout : fopen(outPath, textOutput ? "w" : "wb");
+	if (out == NULL) {
+		perror(outPath);
+		WorkloadFree(&workload);
+		return 1;
+	}
+
+	int result = textOutput ? WorkloadWriteText(&workload, out) : WorkloadWriteBinary(&workload, out);
+	if (fclose(out) != 0 || result < 0) {
+		fprintf(stderr, "%s: write failed.\n", outPath);
+		result = -1;
+	}
+	fprintf(stderr, "%u semaphores, %u processes, %llu steps\n", workload.numSems, workload.numProcs,
+		(unsigned long long)workload.numOps);
+	WorkloadFree(&workload);
+	return result < 0 ? 1 : 0;
+}
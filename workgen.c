@@ -0,0 +1,317 @@
+/***************************************************************
+ * Synthetic workload generator for the scheduling simulation  *
+ * Prints a command script for batch mode (proc -b) to stdout. *
+ ***************************************************************/
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/***************************************************************
+ * Defines and Constants                                       *
+ ***************************************************************/
+#define NUM_PRIORITIES	3
+#define DEFAULT_SEMAPHORES	5
+#define OUTPUT_BUF_SIZE	(1024 * 1024)
+#define MAX_BATCH_SIZE	8
+#define MAX_TICKS	16	// Longest sleep or run the generator asks for
+#define MAX_WORKLOAD_STEPS	8	// Most steps a generated workload process takes, besides its send
+#define WORKLOAD_GROUP	4	// Generated workload processes come as a server and its clients
+
+/**
+ * Commands the generator can mix, with their default relative weights.
+ * Forks are off by default: a fork fails while INIT is running, which the generator can't
+ * predict, and every failure shifts the PIDs of later processes away from the model.
+ * Async send, try-receive and batch receive are off by default so the default script stays
+ * the same; mix them in for producer/consumer workloads, e.g. -m s=0,r=0,a=20,b=10.
+ * Switching CPUs is off by default too; give it a weight along with -c for multi-CPU runs.
+ * So are sleeping and running the clock forward.
+ */
+static const char MIX_COMMANDS[] = 
+	{'c', 'f', 'k', 'q', 's', 'r', 'y', 'p', 'v', 'a', 'g', 'b', 'u', 'z', 'w'};
+#define NUM_MIX_COMMANDS	((int)sizeof(MIX_COMMANDS))
+static const int DEFAULT_WEIGHTS[NUM_MIX_COMMANDS] = {10, 0, 8, 30, 10, 10, 10, 8, 9, 0, 0, 0, 0, 0, 0};
+
+/***************************************************************
+ * Statics                                                     *
+ ***************************************************************/
+static int weights[NUM_MIX_COMMANDS];
+static int numSemaphores = DEFAULT_SEMAPHORES;
+static int numCpus = 1;
+static int *livePids = NULL;	// Model of the live processes, used to pick command targets
+static int numLivePids = 0;
+static int nextPid = 1;			// PID 0 is the INIT process
+static unsigned int randomState = 1;
+static char outputBuffer[OUTPUT_BUF_SIZE];
+
+/***************************************************************
+ * Function Prototypes                                         *
+ ***************************************************************/
+static int ParseMix(char *mix);
+static void PrintWorkload(int numProcesses);
+static unsigned int NextRandom();
+static int PickCommand(int totalWeight);
+static int RandomLivePid();
+static void AddLivePid();
+static void RemoveLivePid(int index);
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * Usage: workgen [-n commands] [-p processes] [-s seed] [-m mix] [-S semaphores] [-c cpus]
+ * -n: number of commands after the initial ramp-up (default 100000)
+ * -p: number of processes to create before the mix starts, and to keep alive (default 100)
+ * -s: random seed, so the same arguments always give the same script (default 1)
+ * -m: relative weights of each command, e.g. q=30,c=10,k=8 (unlisted commands keep defaults)
+ * -S: number of semaphores to create and use (default 5)
+ * -c: number of CPUs the u command picks from, to match proc -c (default 1)
+ * -W: print a workload file for proc -W instead, with -p processes and -S semaphores
+ */
+int main(int argc, char *argv[]) {
+	long numCommands = 100000;
+	int numProcesses = 100;
+	int workloadOutput = 0;
+	int opt;
+
+	memcpy(weights, DEFAULT_WEIGHTS, sizeof(weights));
+	while ((opt = getopt(argc, argv, "n:p:s:m:S:c:W")) != -1) {
+		switch (opt) {
+			case 'n':
+				numCommands = atol(optarg);
+				break;
+			case 'p':
+				numProcesses = atoi(optarg);
+				break;
+			case 's':
+				randomState = (unsigned int)strtoul(optarg, NULL, 10);
+				randomState = randomState ? randomState : 1;
+				break;
+			case 'm':
+				if (ParseMix(optarg) < 0) {
+					return 1;
+				}
+				break;
+			case 'S':
+				numSemaphores = atoi(optarg);
+				break;
+			case 'c':
+				numCpus = atoi(optarg);
+				break;
+			case 'W':
+				workloadOutput = 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n commands] [-p processes] [-s seed] [-m mix] [-S semaphores] "
+					"[-c cpus] [-W]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (numCommands < 0 || numProcesses < 1 || numSemaphores < 1 || numCpus < 1) {
+		fprintf(stderr, "The command, process, semaphore and CPU counts must be positive.\n");
+		return 1;
+	}
+
+	if (workloadOutput) {
+		setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+		PrintWorkload(numProcesses);
+		return 0;
+	}
+
+	int totalWeight = 0;
+	for (int i = 0; i < NUM_MIX_COMMANDS; i++) {
+		totalWeight += weights[i];
+	}
+	if (totalWeight <= 0) {
+		fprintf(stderr, "At least one command needs a positive weight.\n");
+		return 1;
+	}
+
+	livePids = (int *)malloc(sizeof(int) * ((size_t)numProcesses + numCommands + 1));
+	if (livePids == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		return 1;
+	}
+	setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+	/* Ramp up: semaphores and the initial processes */
+	for (int id = 0; id < numSemaphores; id++) {
+		printf("n %d %d\n", id, 1);
+	}
+	for (int i = 0; i < numProcesses; i++) {
+		printf("c %d\n", (int)(NextRandom() % NUM_PRIORITIES));
+		AddLivePid();
+	}
+
+	/* Mix: creation and kills are steered to keep roughly numProcesses alive */
+	for (long i = 0; i < numCommands; i++) {
+		char command = MIX_COMMANDS[PickCommand(totalWeight)];
+		if ((command == 'c' || command == 'f') && numLivePids > numProcesses) {
+			command = 'k';
+		} else if (command == 'k' && numLivePids < numProcesses) {
+			command = 'c';
+		}
+		if (numLivePids == 0 && command != 'c' && command != 'q') {
+			command = 'c';
+		}
+
+		switch (command) {
+			case 'c':
+				printf("c %d\n", (int)(NextRandom() % NUM_PRIORITIES));
+				AddLivePid();
+				break;
+			case 'f':
+				/* Assumes the fork succeeds, see the note on the default weights */
+				printf("f\n");
+				AddLivePid();
+				break;
+			case 'k': {
+				int index = (int)(NextRandom() % numLivePids);
+				printf("k %d\n", livePids[index]);
+				RemoveLivePid(index);
+				break;
+			}
+			case 's':
+				printf("s %d m%ld\n", RandomLivePid(), i);
+				break;
+			case 'y':
+				printf("y %d r%ld\n", RandomLivePid(), i);
+				break;
+			case 'a':
+				printf("a %d m%ld\n", RandomLivePid(), i);
+				break;
+			case 'b':
+				printf("b %d\n", (int)(NextRandom() % MAX_BATCH_SIZE) + 1);
+				break;
+			case 'p':
+			case 'v':
+				printf("%c %d\n", command, (int)(NextRandom() % (unsigned int)numSemaphores));
+				break;
+			case 'u':
+				printf("u %d\n", (int)(NextRandom() % (unsigned int)numCpus));
+				break;
+			case 'z':
+			case 'w':
+				printf("%c %d\n", command, (int)(NextRandom() % MAX_TICKS) + 1);
+				break;
+			default:
+				printf("%c\n", command);
+				break;
+		}
+	}
+
+	free(livePids);
+	return 0;
+}
+
+/***************************************************************
+ * Helper Functions                                            *
+ ***************************************************************/
+
+/**
+ * Parses a mix such as "q=30,c=10" into the weights table.
+ * Returns 0 on success, -1 if the mix is malformed.
+ */
+static int ParseMix(char *mix) {
+	for (char *entry = strtok(mix, ","); entry != NULL; entry = strtok(NULL, ",")) {
+		char *command = memchr(MIX_COMMANDS, entry[0], NUM_MIX_COMMANDS);
+		if (command == NULL || entry[1] != '=' || atoi(entry + 2) < 0) {
+			fprintf(stderr, "Bad mix entry '%s'. Use command=weight with commands from: ", entry);
+			fprintf(stderr, "%.*s\n", NUM_MIX_COMMANDS, MIX_COMMANDS);
+			return -1;
+		}
+		weights[command - MIX_COMMANDS] = atoi(entry + 2);
+	}
+	return 0;
+}
+
+/**
+ * Prints a workload of processes arriving a few ticks apart, in groups of a server and the
+ * clients that each send it one message. Servers receive and reply to each of their clients,
+ * and clients mix CPU bursts, I/O waits and critical sections guarded by a semaphore.
+ */
+static void PrintWorkload(int numProcesses) {
+	printf("# Generated by workgen -W: %d processes, %d semaphores\n", numProcesses, numSemaphores);
+	for (int id = 0; id < numSemaphores; id++) {
+		printf("sem %d %d\n", id, 1);
+	}
+
+	unsigned long arrival = 0;
+	for (int i = 0; i < numProcesses; i++) {
+		arrival += NextRandom() % 3;
+		printf("%lu %d", arrival, (int)(NextRandom() % NUM_PRIORITIES));
+
+		int server = i - i % WORKLOAD_GROUP;
+		if (i == server) {
+			int clients = numProcesses - i - 1 < WORKLOAD_GROUP - 1 ? numProcesses - i - 1 : WORKLOAD_GROUP - 1;
+			for (int client = 0; client < clients; client++) {
+				printf(" recv cpu %d reply", (int)(NextRandom() % MAX_TICKS) + 1);
+			}
+			printf("\n");
+			continue;
+		}
+
+		int numSteps = (int)(NextRandom() % MAX_WORKLOAD_STEPS) + 1;
+		int sendStep = (int)(NextRandom() % (unsigned int)numSteps);
+		for (int step = 0; step < numSteps; step++) {
+			if (step == sendStep) {
+				printf(" send %d", server);
+			}
+			int ticks = (int)(NextRandom() % MAX_TICKS) + 1;
+			switch (NextRandom() % 4) {
+				case 0:
+					printf(" io %d", ticks);
+					break;
+				case 1: {
+					int id = (int)(NextRandom() % (unsigned int)numSemaphores);
+					printf(" p %d cpu %d v %d", id, ticks, id);
+					break;
+				}
+				default:
+					printf(" cpu %d", ticks);
+					break;
+			}
+		}
+		printf("\n");
+	}
+}
+
+/* Small deterministic xorshift generator */
+static unsigned int NextRandom() {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+/* Picks a command index with probability proportional to its weight */
+static int PickCommand(int totalWeight) {
+	int pick = (int)(NextRandom() % (unsigned int)totalWeight);
+	for (int i = 0; i < NUM_MIX_COMMANDS; i++) {
+		pick -= weights[i];
+		if (pick < 0) {
+			return i;
+		}
+	}
+	return NUM_MIX_COMMANDS - 1;
+}
+
+/* Returns a random PID from the model of live processes */
+static int RandomLivePid() {
+	return livePids[NextRandom() % numLivePids];
+}
+
+/* Records that the next PID has been handed out to a live process */
+static void AddLivePid() {
+	livePids[numLivePids++] = nextPid++;
+}
+
+/* Forgets a live process by moving the last one into its slot */
+static void RemoveLivePid(int index) {
+	livePids[index] = livePids[--numLivePids];
+}
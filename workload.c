@@ -0,0 +1,446 @@
+/***************************************************************
+ * Workload files: per-process arrival, priority and steps     *
+ ***************************************************************/
+
+/**
+ * The text form has one line per semaphore or process, with # starting a comment:
+ *	sem [id] [initial value]
+ *	[arrival tick] [priority] [step] [step] ...
+ * where each step is one of cpu [ticks], io [ticks], send [process index], recv, reply,
+ * p [semaphore id] or v [semaphore id]. Process lines must be in arrival order, and a process's
+ * index is its position among them, counting from 0.
+ */
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include "workload.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/***************************************************************
+ * Defines and Constants                                       *
+ ***************************************************************/
+#define MIN_ARRAY_CAPACITY	64
+
+const char * const WL_OP_NAMES[NUM_WL_OP_TYPES] = {"cpu", "io", "send", "recv", "reply", "p", "v"};
+
+/* Whether each step type takes an argument */
+static const int WL_OP_HAS_ARG[NUM_WL_OP_TYPES] = {1, 1, 1, 0, 0, 1, 1};
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/* Arrays a text workload is parsed into */
+typedef struct WL_BUILDER {
+	WL_SEM *sems;
+	WL_PROC *procs;
+	WL_OP *ops;
+	uint64_t semCapacity;
+	uint64_t procCapacity;
+	uint64_t opCapacity;
+	uint64_t numSems;
+	uint64_t numProcs;
+	uint64_t numOps;
+} WL_BUILDER;
+
+/***************************************************************
+ * Statics                                                     *
+ ***************************************************************/
+static int loadBinary(WORKLOAD *workload, int fd, const char *path);
+static int loadText(WORKLOAD *workload, int fd, const char *path);
+static int parseLine(WL_BUILDER *builder, char *line, const char *path, unsigned long lineNo);
+static int parseNumber(const char *token, uint64_t max, uint64_t *value);
+static int growArray(void **array, uint64_t *capacity, uint64_t needed, size_t elementSize);
+static int validateWorkload(const WORKLOAD *workload, const char *path);
+static int compareSemIds(const void *a, const void *b);
+
+/***************************************************************
+ * Global Functions                                            *
+ ***************************************************************/
+
+/**
+ * Loads a workload in either form, telling them apart by the binary magic.
+ * A binary workload is mapped rather than read. Reports what's wrong to stderr.
+ * Returns 0 on success, -1 on failure.
+ */
+int WorkloadLoad(WORKLOAD *workload, const char *path) {
+	memset(workload, 0, sizeof(*workload));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	char magic[WORKLOAD_MAGIC_LEN];
+	int result;
+	if (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+			memcmp(magic, WORKLOAD_MAGIC, WORKLOAD_MAGIC_LEN) == 0) {
+		result = loadBinary(workload, fd, path);
+	} else {
+		result = loadText(workload, fd, path);
+	}
+	if (result == 0 && validateWorkload(workload, path) < 0) {
+		WorkloadFree(workload);
+		result = -1;
+	}
+	return result;
+}
+
+/**
+ * Writes the workload in text form, which loads back into the same workload.
+ * Returns 0 on success, -1 on a write error.
+ */
+int WorkloadWriteText(const WORKLOAD *workload, FILE *out) {
+	fprintf(out, "# %u semaphores, %u processes, %llu steps\n", workload->numSems, workload->numProcs,
+		(unsigned long long)workload->numOps);
+	for (uint32_t i = 0; i < workload->numSems; i++) {
+		fprintf(out, "sem %d %d\n", workload->sems[i].id, workload->sems[i].value);
+	}
+	fprintf(out, "# arrival priority steps\n");
+	for (uint32_t i = 0; i < workload->numProcs; i++) {
+		const WL_PROC *proc = &workload->procs[i];
+		fprintf(out, "%llu %u", (unsigned long long)proc->arrival, proc->priority);
+		const WL_OP *steps = &workload->ops[proc->firstOp];
+		for (const WL_OP *op = steps; op < steps + proc->numOps; op++) {
+			if (WL_OP_HAS_ARG[op->type]) {
+				fprintf(out, " %s %u", WL_OP_NAMES[op->type], op->arg);
+			} else {
+				fprintf(out, " %s", WL_OP_NAMES[op->type]);
+			}
+		}
+		fputc('\n', out);
+	}
+	return ferror(out) ? -1 : 0;
+}
+
+/**
+ * Writes the workload in binary form.
+ * Returns 0 on success, -1 on a write error.
+ */
+int WorkloadWriteBinary(const WORKLOAD *workload, FILE *out) {
+	WL_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, WORKLOAD_MAGIC, WORKLOAD_MAGIC_LEN);
+	header.numProcs = workload->numProcs;
+	header.numSems = workload->numSems;
+	header.numOps = workload->numOps;
+
+	if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+			fwrite(workload->sems, sizeof(WL_SEM), workload->numSems, out) != workload->numSems ||
+			fwrite(workload->procs, sizeof(WL_PROC), workload->numProcs, out) != workload->numProcs ||
+			fwrite(workload->ops, sizeof(WL_OP), workload->numOps, out) != workload->numOps) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Unmaps or frees whatever the workload was loaded into */
+void WorkloadFree(WORKLOAD *workload) {
+	if (workload->mapping != NULL) {
+		munmap(workload->mapping, workload->mappingSize);
+	} else {
+		free((void *)workload->sems);
+		free((void *)workload->procs);
+		free((void *)workload->ops);
+	}
+	memset(workload, 0, sizeof(*workload));
+}
+
+/***************************************************************
+ * Static Functions                                            *
+ ***************************************************************/
+
+/**
+ * Maps a binary workload and points the workload's arrays into the mapping.
+ * Closes fd. Returns 0 on success, -1 if the file is truncated or can't be mapped.
+ */
+static int loadBinary(WORKLOAD *workload, int fd, const char *path) {
+	struct stat info;
+	if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(WL_HEADER)) {
+		fprintf(stderr, "%s: truncated workload header.\n", path);
+		close(fd);
+		return -1;
+	}
+
+	size_t size = (size_t)info.st_size;
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		perror(path);
+		return -1;
+	}
+
+	const WL_HEADER *header = (const WL_HEADER *)mapping;
+	if (header->numOps > size / sizeof(WL_OP) ||
+			sizeof(WL_HEADER) + header->numSems * sizeof(WL_SEM) + header->numProcs * sizeof(WL_PROC) +
+			header->numOps * sizeof(WL_OP) != size) {
+		fprintf(stderr, "%s: the file size doesn't match the workload header.\n", path);
+		munmap(mapping, size);
+		return -1;
+	}
+
+	const char *records = (const char *)mapping + sizeof(WL_HEADER);
+	workload->sems = (const WL_SEM *)records;
+	workload->procs = (const WL_PROC *)(records + header->numSems * sizeof(WL_SEM));
+	workload->ops = (const WL_OP *)(records + header->numSems * sizeof(WL_SEM) +
+		header->numProcs * sizeof(WL_PROC));
+	workload->numSems = header->numSems;
+	workload->numProcs = header->numProcs;
+	workload->numOps = header->numOps;
+	workload->mapping = mapping;
+	workload->mappingSize = size;
+
+	/* Processes are admitted in order, so read ahead of them */
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+/**
+ * Parses a text workload into arrays of its own.
+ * Closes fd. Returns 0 on success, -1 on a syntax error or if out of memory.
+ */
+static int loadText(WORKLOAD *workload, int fd, const char *path) {
+	FILE *in = fdopen(fd, "r");
+	if (in == NULL) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+
+	WL_BUILDER builder;
+	memset(&builder, 0, sizeof(builder));
+	char *line = NULL;
+	size_t lineCapacity = 0;
+	unsigned long lineNo = 0;
+	int result = 0;
+	while (getline(&line, &lineCapacity, in) >= 0) {
+		lineNo++;
+		if (parseLine(&builder, line, path, lineNo) < 0) {
+			result = -1;
+			break;
+		}
+	}
+	free(line);
+	fclose(in);
+
+	if (result == 0 && (builder.numSems > UINT32_MAX || builder.numProcs > UINT32_MAX)) {
+		fprintf(stderr, "%s: too many semaphores or processes.\n", path);
+		result = -1;
+	}
+	if (result < 0) {
+		free(builder.sems);
+		free(builder.procs);
+		free(builder.ops);
+		return -1;
+	}
+
+	workload->sems = builder.sems;
+	workload->procs = builder.procs;
+	workload->ops = builder.ops;
+	workload->numSems = (uint32_t)builder.numSems;
+	workload->numProcs = (uint32_t)builder.numProcs;
+	workload->numOps = builder.numOps;
+	return 0;
+}
+
+/**
+ * Adds the semaphore or process on one line of a text workload.
+ * Returns 0 on success, -1 on a syntax error or if out of memory.
+ */
+static int parseLine(WL_BUILDER *builder, char *line, const char *path, unsigned long lineNo) {
+	char *comment = strchr(line, '#');
+	if (comment != NULL) {
+		*comment = '\0';
+	}
+
+	const char *separators = " \t\r\n";
+	char *save = NULL;
+	char *token = strtok_r(line, separators, &save);
+	if (token == NULL) {
+		return 0;
+	}
+
+	/* Semaphore declaration */
+	if (strcmp(token, "sem") == 0) {
+		char *idToken = strtok_r(NULL, separators, &save);
+		char *valueToken = strtok_r(NULL, separators, &save);
+		uint64_t id;
+		uint64_t value;
+		if (idToken == NULL || valueToken == NULL || strtok_r(NULL, separators, &save) != NULL ||
+				parseNumber(idToken, INT32_MAX, &id) < 0 || parseNumber(valueToken, INT32_MAX, &value) < 0) {
+			fprintf(stderr, "%s:%lu: expected sem [id] [initial value].\n", path, lineNo);
+			return -1;
+		}
+		if (growArray((void **)&builder->sems, &builder->semCapacity, builder->numSems + 1, sizeof(WL_SEM)) < 0) {
+			fprintf(stderr, "%s:%lu: out of memory.\n", path, lineNo);
+			return -1;
+		}
+		builder->sems[builder->numSems].id = (int32_t)id;
+		builder->sems[builder->numSems].value = (int32_t)value;
+		builder->numSems++;
+		return 0;
+	}
+
+	/* Process: arrival, priority, then its steps */
+	uint64_t arrival;
+	uint64_t priority;
+	char *priorityToken = strtok_r(NULL, separators, &save);
+	if (parseNumber(token, UINT64_MAX, &arrival) < 0 || priorityToken == NULL ||
+			parseNumber(priorityToken, UINT32_MAX, &priority) < 0) {
+		fprintf(stderr, "%s:%lu: expected [arrival tick] [priority] [steps...].\n", path, lineNo);
+		return -1;
+	}
+	if (growArray((void **)&builder->procs, &builder->procCapacity, builder->numProcs + 1, sizeof(WL_PROC)) < 0) {
+		fprintf(stderr, "%s:%lu: out of memory.\n", path, lineNo);
+		return -1;
+	}
+	WL_PROC *proc = &builder->procs[builder->numProcs++];
+	proc->arrival = arrival;
+	proc->priority = (uint32_t)priority;
+	proc->firstOp = builder->numOps;
+	proc->numOps = 0;
+
+	while ((token = strtok_r(NULL, separators, &save)) != NULL) {
+		int type = 0;
+		while (type < NUM_WL_OP_TYPES && strcmp(token, WL_OP_NAMES[type]) != 0) {
+			type++;
+		}
+		if (type == NUM_WL_OP_TYPES) {
+			fprintf(stderr, "%s:%lu: unknown step '%s'.\n", path, lineNo, token);
+			return -1;
+		}
+
+		uint64_t arg = 0;
+		if (WL_OP_HAS_ARG[type]) {
+			char *argToken = strtok_r(NULL, separators, &save);
+			if (argToken == NULL || parseNumber(argToken, UINT32_MAX, &arg) < 0) {
+				fprintf(stderr, "%s:%lu: expected a number after '%s'.\n", path, lineNo, WL_OP_NAMES[type]);
+				return -1;
+			}
+		}
+		if (proc->numOps == UINT32_MAX ||
+				growArray((void **)&builder->ops, &builder->opCapacity, builder->numOps + 1, sizeof(WL_OP)) < 0) {
+			fprintf(stderr, "%s:%lu: too many steps.\n", path, lineNo);
+			return -1;
+		}
+		builder->ops[builder->numOps].type = (uint32_t)type;
+		builder->ops[builder->numOps].arg = (uint32_t)arg;
+		builder->numOps++;
+		proc->numOps++;
+	}
+	return 0;
+}
+
+/**
+ * Parses a whole token as a decimal number no greater than max.
+ * Returns 0 on success, -1 if it isn't one.
+ */
+static int parseNumber(const char *token, uint64_t max, uint64_t *value) {
+	if (*token < '0' || *token > '9') {
+		return -1;
+	}
+	char *end;
+	unsigned long long parsed = strtoull(token, &end, 10);
+	if (*end != '\0' || parsed > max) {
+		return -1;
+	}
+	*value = parsed;
+	return 0;
+}
+
+/**
+ * Makes room for at least needed elements, doubling the capacity.
+ * Returns 0 on success, -1 if out of memory.
+ */
+static int growArray(void **array, uint64_t *capacity, uint64_t needed, size_t elementSize) {
+	if (needed <= *capacity) {
+		return 0;
+	}
+	uint64_t newCapacity = *capacity ? *capacity * 2 : MIN_ARRAY_CAPACITY;
+	void *grown = realloc(*array, newCapacity * elementSize);
+	if (grown == NULL) {
+		return -1;
+	}
+	*array = grown;
+	*capacity = newCapacity;
+	return 0;
+}
+
+/**
+ * Checks everything the simulator relies on: processes in arrival order with valid priorities
+ * and steps inside the step array, positive burst lengths, sends to existing process indexes,
+ * and P and V only on declared semaphores. Returns 0 if valid, -1 otherwise.
+ */
+static int validateWorkload(const WORKLOAD *workload, const char *path) {
+	int32_t *semIds = (int32_t *)malloc((workload->numSems + 1) * sizeof(int32_t));
+	if (semIds == NULL) {
+		fprintf(stderr, "%s: out of memory.\n", path);
+		return -1;
+	}
+	for (uint32_t i = 0; i < workload->numSems; i++) {
+		semIds[i] = workload->sems[i].id;
+		if (workload->sems[i].id < 0 || workload->sems[i].value < 0) {
+			fprintf(stderr, "%s: semaphore %d has a negative ID or initial value.\n", path,
+				workload->sems[i].id);
+			free(semIds);
+			return -1;
+		}
+	}
+	qsort(semIds, workload->numSems, sizeof(int32_t), compareSemIds);
+	for (uint32_t i = 1; i < workload->numSems; i++) {
+		if (semIds[i] == semIds[i - 1]) {
+			fprintf(stderr, "%s: semaphore %d is declared twice.\n", path, semIds[i]);
+			free(semIds);
+			return -1;
+		}
+	}
+
+	int result = 0;
+	for (uint32_t i = 0; i < workload->numProcs && result == 0; i++) {
+		const WL_PROC *proc = &workload->procs[i];
+		if (proc->priority >= WORKLOAD_PRIORITIES) {
+			fprintf(stderr, "%s: process %u has invalid priority %u.\n", path, i, proc->priority);
+			result = -1;
+		} else if (i > 0 && proc->arrival < workload->procs[i - 1].arrival) {
+			fprintf(stderr, "%s: process %u arrives before the process listed ahead of it.\n", path, i);
+			result = -1;
+		} else if (proc->numOps > workload->numOps || proc->firstOp > workload->numOps - proc->numOps) {
+			fprintf(stderr, "%s: the steps of process %u are out of range.\n", path, i);
+			result = -1;
+		}
+
+		for (uint64_t j = proc->firstOp; result == 0 && j < proc->firstOp + proc->numOps; j++) {
+			const WL_OP *op = &workload->ops[j];
+			int32_t semId = (int32_t)op->arg;
+			if (op->type >= NUM_WL_OP_TYPES) {
+				fprintf(stderr, "%s: process %u has an unknown step type %u.\n", path, i, op->type);
+				result = -1;
+			} else if ((op->type == WL_CPU || op->type == WL_IO) && (op->arg == 0 || op->arg > INT32_MAX)) {
+				fprintf(stderr, "%s: process %u has a %s step of %u ticks.\n", path, i,
+					WL_OP_NAMES[op->type], op->arg);
+				result = -1;
+			} else if (op->type == WL_SEND && op->arg >= workload->numProcs) {
+				fprintf(stderr, "%s: process %u sends to process %u, which doesn't exist.\n", path, i, op->arg);
+				result = -1;
+			} else if ((op->type == WL_P || op->type == WL_V) && (op->arg > INT32_MAX ||
+					bsearch(&semId, semIds, workload->numSems, sizeof(int32_t), compareSemIds) == NULL)) {
+				fprintf(stderr, "%s: process %u uses semaphore %u, which isn't declared.\n", path, i, op->arg);
+				result = -1;
+			}
+		}
+	}
+	free(semIds);
+	return result;
+}
+
+static int compareSemIds(const void *a, const void *b) {
+	int32_t first = *(const int32_t *)a;
+	int32_t second = *(const int32_t *)b;
+	return (first > second) - (first < second);
+}
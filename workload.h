@@ -0,0 +1,87 @@
+#ifndef _WORKLOAD_H_
+#define _WORKLOAD_H_
+
+/***************************************************************
+ * Imports                                                     *
+ ***************************************************************/
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/***************************************************************
+ * Defines                                                     *
+ ***************************************************************/
+#define WORKLOAD_MAGIC		"PSWLBIN1"	// First 8 bytes of a binary workload
+#define WORKLOAD_MAGIC_LEN	8
+#define WORKLOAD_PRIORITIES	3	// HIGH, NORMAL and LOW; workload processes can't be INIT
+
+/***************************************************************
+ * Structs                                                     *
+ ***************************************************************/
+
+/* What a workload process does at one step */
+typedef enum WL_OP_TYPE {
+	WL_CPU,		// arg: ticks to run for
+	WL_IO,		// arg: ticks to wait off the CPU
+	WL_SEND,	// arg: index of the process to send to, then wait for its reply
+	WL_RECV,	// Wait for a message
+	WL_REPLY,	// Reply to the sender of the last message received
+	WL_P,		// arg: semaphore ID
+	WL_V,		// arg: semaphore ID
+	NUM_WL_OP_TYPES
+} WL_OP_TYPE;
+
+/**
+ * The binary form is the header followed by the semaphore, process and step arrays, exactly as
+ * they are laid out in memory, so a binary workload is used straight from its mapping.
+ * Fields are fixed-width in host byte order, and every record is a multiple of 8 bytes.
+ */
+typedef struct WL_HEADER {
+	char magic[WORKLOAD_MAGIC_LEN];
+	uint32_t numProcs;
+	uint32_t numSems;
+	uint64_t numOps;
+	uint64_t reserved;
+} WL_HEADER;
+
+typedef struct WL_SEM {
+	int32_t id;
+	int32_t value;		// Initial value
+} WL_SEM;
+
+/* Processes are in arrival order. Sends name processes by their index in this order. */
+typedef struct WL_PROC {
+	uint64_t arrival;	// Tick the process is created at
+	uint32_t priority;
+	uint32_t numOps;
+	uint64_t firstOp;	// Index of the process's first step in the step array
+} WL_PROC;
+
+typedef struct WL_OP {
+	uint32_t type;		// WL_OP_TYPE
+	uint32_t arg;
+} WL_OP;
+
+/* A loaded workload. The arrays are either owned or point into a mapped binary file. */
+typedef struct WORKLOAD {
+	const WL_SEM *sems;
+	const WL_PROC *procs;
+	const WL_OP *ops;
+	uint32_t numSems;
+	uint32_t numProcs;
+	uint64_t numOps;
+	void *mapping;		// Mapped binary file, NULL for a parsed text file
+	size_t mappingSize;
+} WORKLOAD;
+
+extern const char * const WL_OP_NAMES[NUM_WL_OP_TYPES];
+
+/***************************************************************
+ * Function prototypes                                         *
+ ***************************************************************/
+int WorkloadLoad(WORKLOAD *workload, const char *path);
+int WorkloadWriteText(const WORKLOAD *workload, FILE *out);
+int WorkloadWriteBinary(const WORKLOAD *workload, FILE *out);
+void WorkloadFree(WORKLOAD *workload);
+
+#endif /* _WORKLOAD_H_ */